@@ -0,0 +1,195 @@
+// Offline asset cooker. Cooks every model referenced by the given scenes into the
+// runtime mesh format, keeping a cache keyed by the content hash of each source so
+// unchanged assets are copied instead of imported again.
+//
+// assetcook --source-dir <dir> --output-dir <dir> --cache-dir <dir> [--bench] <scene.json>...
+
+#include "meshfile.h"
+#include "meshimport.h"
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Bump when the importer or its post-processing changes in a way that alters the
+// cooked output, so every cached entry is invalidated.
+static const char* cookerVersion = "assetcook-3";
+
+struct CookOptions {
+	fs::path sourceDir = ".";
+	fs::path outputDir = ".";
+	fs::path cacheDir = "assetcache";
+	bool bench = false;
+	std::vector<fs::path> scenes;
+};
+
+struct CookStats {
+	size_t hits = 0;
+	size_t misses = 0;
+	double milliseconds = 0;
+};
+
+static CookOptions parseOptions(int argc, char** argv)
+{
+	CookOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto next = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				throw std::runtime_error("missing value for " + arg);
+			}
+			return argv[++i];
+		};
+
+		if (arg == "--source-dir") {
+			options.sourceDir = next();
+		}
+		else if (arg == "--output-dir") {
+			options.outputDir = next();
+		}
+		else if (arg == "--cache-dir") {
+			options.cacheDir = next();
+		}
+		else if (arg == "--bench") {
+			options.bench = true;
+		}
+		else if (arg.rfind("--", 0) == 0) {
+			throw std::runtime_error("unknown option " + arg);
+		}
+		else {
+			options.scenes.push_back(arg);
+		}
+	}
+	if (options.scenes.empty()) {
+		throw std::runtime_error("no scenes given");
+	}
+	return options;
+}
+
+static std::set<std::string> collectModels(const CookOptions& options)
+{
+	std::set<std::string> models;
+	for (const fs::path& scene : options.scenes) {
+		std::ifstream file(options.sourceDir / scene);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open " + (options.sourceDir / scene).string());
+		}
+		rapidjson::IStreamWrapper stream(file);
+		rapidjson::Document document;
+		document.ParseStream(stream);
+		if (document.HasParseError() || !document.HasMember("models")) {
+			throw std::runtime_error("failed to parse " + scene.string());
+		}
+		for (const auto& model : document["models"].GetArray()) {
+			models.insert(model["file"].GetString());
+		}
+	}
+	return models;
+}
+
+// FNV-1a over the cooker version, the mesh format version and the source bytes.
+static std::string hashSource(const fs::path& source)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto add = [&](const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+	};
+	add(cookerVersion, strlen(cookerVersion));
+	add(&meshFileVersion, sizeof(meshFileVersion));
+
+	MappedFile file(source.string());
+	add(file.data(), file.size());
+
+	char text[17];
+	snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+	return text;
+}
+
+static void printOptimization(const std::string& model, const MeshOptimizationStats& stats)
+{
+	std::cout << model << ": ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter
+		<< ", vertices " << stats.vertexBytesBefore << " -> " << stats.vertexBytesAfter << " bytes"
+		<< ", indices " << stats.indexBytesBefore << " -> " << stats.indexBytesAfter << " bytes" << std::endl;
+	for (size_t l = 0; l < maxMeshLods && stats.lodTriangles[l] > 0; l++) {
+		std::cout << model << ": lod " << l << " " << stats.lodTriangles[l] << " triangles, error " << stats.lodErrors[l] << std::endl;
+	}
+}
+
+static CookStats cook(const CookOptions& options, const fs::path& cacheDir)
+{
+	auto start = std::chrono::steady_clock::now();
+	CookStats stats;
+
+	fs::create_directories(cacheDir);
+	fs::create_directories(options.outputDir / "models");
+	for (const std::string& model : collectModels(options)) {
+		fs::path source = options.sourceDir / "models" / model;
+		fs::path cached = cacheDir / (hashSource(source) + ".mesh");
+		bool hit = fs::exists(cached);
+		if (hit) {
+			stats.hits++;
+		}
+		else {
+			stats.misses++;
+			ImportedMesh mesh = importMesh(source.string());
+			writeMeshFile(cached.string(), mesh.getView());
+			printOptimization(model, mesh.stats);
+		}
+
+		// Copied rather than linked so the output is newer than the source the
+		// runtime compares it against.
+		fs::path output = options.outputDir / "models" / fs::path(model).replace_extension(".mesh");
+		fs::copy_file(cached, output, fs::copy_options::overwrite_existing);
+		fs::last_write_time(output, fs::file_time_type::clock::now());
+		std::cout << (hit ? "cached " : "cooked ") << model << " -> " << cached.filename().string() << std::endl;
+	}
+
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+static void printStats(const char* label, const CookStats& stats)
+{
+	std::cout << label << ": " << stats.misses << " cooked, " << stats.hits << " cached in " << stats.milliseconds << " ms" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		CookOptions options = parseOptions(argc, argv);
+		if (options.bench) {
+			// Cold and warm passes against a scratch cache, so the real cache is left alone.
+			fs::path scratch = options.cacheDir / "bench";
+			fs::remove_all(scratch);
+			printStats("cold", cook(options, scratch));
+			printStats("warm", cook(options, scratch));
+			fs::remove_all(scratch);
+		}
+		else {
+			printStats("cook", cook(options, options.cacheDir));
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
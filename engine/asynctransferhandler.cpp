@@ -1,34 +1,59 @@
 #include "asynctransferhandler.h"
 
-AsyncTransferHandler::AsyncTransferHandler(const VulkanContext& vkCtx) : _vkCtx(vkCtx), _pos(0), _size(16777216)
-{
-	auto stagingInfo = vk::BufferCreateInfo()
-		.setUsage(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferSrc)
-		.setSharingMode(vk::SharingMode::eExclusive)
-		.setSize(_size);
-
-	_stagingBuffer = vkCtx.getDevice().createBuffer(stagingInfo);
-	auto memoryRequirements = vkCtx.getDevice().getBufferMemoryRequirements(_stagingBuffer);
+#include "cpuprofiler.h"
 
-	auto stagingAllocInfo = vk::MemoryAllocateInfo()
-		.setAllocationSize(memoryRequirements.size)
-		.setMemoryTypeIndex(vkCtx.findMemoryType(memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
-	_stagingMemory = vkCtx.getDevice().allocateMemory(stagingAllocInfo);
-	vkCtx.getDevice().bindBufferMemory(_stagingBuffer, _stagingMemory, 0);
-
-	_commandPool = vkCtx.getDevice().createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(vkCtx.getQueueFamilies().transferInd.value()).setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
+AsyncTransferHandler::AsyncTransferHandler(const VulkanContext& vkCtx, size_t stagingSize) : _vkCtx(vkCtx), _size(stagingSize)
+{
+	if (_size < stagingAlignment * chunkDivisor) {
+		throw std::runtime_error("staging ring of " + std::to_string(_size) + " bytes is too small");
+	}
+	_staging = Buffer<uint8_t>(vkCtx, _size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+	vmaMapMemory(vkCtx.getAllocator(), _staging.allocation, (void**)&_data);
+
+	_srcFamily = vkCtx.getQueueFamilies().transferInd.value();
+	if (vkCtx.supportsTimelineSemaphores()) {
+		auto timelineInfo = vk::SemaphoreTypeCreateInfo()
+			.setSemaphoreType(vk::SemaphoreType::eTimeline)
+			.setInitialValue(0);
+		_timeline = vkCtx.getDevice().createSemaphore(vk::SemaphoreCreateInfo().setPNext(&timelineInfo));
+	}
+
+	_commandPool = vkCtx.getDevice().createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(_srcFamily).setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
 
 	auto allocInfo = vk::CommandBufferAllocateInfo()
-		.setCommandBufferCount(1)
+		.setCommandBufferCount((uint32_t)submissionCount)
 		.setCommandPool(_commandPool)
 		.setLevel(vk::CommandBufferLevel::ePrimary);
-	_commandBuffer = _vkCtx.getDevice().allocateCommandBuffers(allocInfo)[0];
+	auto commandBuffers = _vkCtx.getDevice().allocateCommandBuffers(allocInfo);
+	for (size_t i = 0; i < submissionCount; i++) {
+		_submissions[i].commandBuffer = commandBuffers[i];
+		_submissions[i].fence = _vkCtx.getDevice().createFence(vk::FenceCreateInfo());
+		_freeSubmissions.push_back(i);
+	}
 }
 
-size_t AsyncTransferHandler::getPos() const
+AsyncTransferHandler::~AsyncTransferHandler()
 {
-	return _pos;
+	if (_recording) {
+		_submissions[*_recording].commandBuffer.end();
+	}
+	while (!_inFlight.empty()) {
+		waitOldest();
+	}
+	for (auto& submission : _submissions) {
+		_vkCtx.deviceDestroy(submission.fence);
+	}
+	if (_timeline) {
+		_vkCtx.deviceDestroy(_timeline);
+	}
+	_vkCtx.deviceDestroy(_commandPool);
+	vmaUnmapMemory(_vkCtx.getAllocator(), _staging.allocation);
+	_staging.destroy(_vkCtx);
 }
 
 size_t AsyncTransferHandler::getSize() const
@@ -36,51 +61,159 @@ size_t AsyncTransferHandler::getSize() const
 	return _size;
 }
 
-bool AsyncTransferHandler::canFit(size_t size) const
+vk::Semaphore AsyncTransferHandler::getTimeline() const
 {
-	return _pos + size < _size;
+	return _timeline;
 }
 
-void AsyncTransferHandler::beginTransferCommand()
+size_t AsyncTransferHandler::allocate(size_t size)
 {
-	auto beginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	_commandBuffer.begin(beginInfo);
-	_data = (uint8_t*)mapStagingBuffer();
+	size = (size + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+	if (size > _size) {
+		throw std::runtime_error("transfer of " + std::to_string(size) + " bytes does not fit the staging ring");
+	}
+
+	while (true) {
+		reclaim();
+		std::optional<size_t> offset;
+		if (_empty) {
+			_head = 0;
+			_tail = 0;
+			offset = 0;
+		}
+		else if (_head > _tail) {
+			if (_head + size <= _size) {
+				offset = _head;
+			}
+			else if (size <= _tail) {
+				offset = 0;
+			}
+		}
+		else if (_head < _tail && _head + size <= _tail) {
+			offset = _head;
+		}
+
+		if (offset) {
+			_head = *offset + size;
+			_empty = false;
+			return *offset;
+		}
+
+		if (!_inFlight.empty()) {
+			waitOldest();
+		}
+		else {
+			// Only the batch being recorded holds the ring, so send it on its way.
+			submit();
+		}
+	}
 }
 
-void AsyncTransferHandler::addTransfer(const void* data, size_t size, vk::Buffer dstBuffer)
+TransferSubmission& AsyncTransferHandler::getRecording()
 {
-	memcpy(_data + _pos, data, size);
-
-	_commandBuffer.copyBuffer(_stagingBuffer, dstBuffer, { vk::BufferCopy()
-		.setSrcOffset(_pos)
-		.setSize(size) });
+	if (!_recording) {
+		if (_freeSubmissions.empty()) {
+			waitOldest();
+		}
+		_recording = _freeSubmissions.front();
+		_freeSubmissions.pop_front();
+
+		auto& submission = _submissions[*_recording];
+		submission.commandBuffer.reset({});
+		submission.commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+		submission.token = _nextToken++;
+	}
+	return _submissions[*_recording];
+}
 
-	_pos += size;
+void AsyncTransferHandler::addTransfer(const void* data, size_t size, vk::Buffer dstBuffer, vk::DeviceSize dstOffset)
+{
+	size_t chunkSize = _size / chunkDivisor / stagingAlignment * stagingAlignment;
+	bool chunked = size > chunkSize;
+	for (size_t done = 0; done < size; done += chunkSize) {
+		size_t chunk = std::min(chunkSize, size - done);
+		size_t offset = allocate(chunk);
+		memcpy(_data + offset, (const uint8_t*)data + done, chunk);
+
+		auto& submission = getRecording();
+		submission.commandBuffer.copyBuffer(_staging.data, dstBuffer, { vk::BufferCopy()
+			.setSrcOffset(offset)
+			.setDstOffset(dstOffset + done)
+			.setSize(chunk) });
+		submission.end = _head;
+		if (chunked && done + chunk < size) {
+			submit();
+		}
+	}
 }
 
-void AsyncTransferHandler::resetAndSubmitPool()
+TransferToken AsyncTransferHandler::submit()
 {
-	_pos = 0;
+	PROFILE_ZONE("AsyncTransferHandler::submit");
+	if (!_recording) {
+		return _nextToken - 1;
+	}
+
+	auto& submission = _submissions[*_recording];
+	submission.commandBuffer.end();
 
-	_commandBuffer.end();
-	unmapStagingBuffer();
 	auto submitInfo = vk::SubmitInfo()
 		.setCommandBufferCount(1)
-		.setPCommandBuffers(&_commandBuffer);
+		.setPCommandBuffers(&submission.commandBuffer);
+	auto timelineInfo = vk::TimelineSemaphoreSubmitInfo()
+		.setSignalSemaphoreValueCount(1)
+		.setPSignalSemaphoreValues(&submission.token);
+	if (_timeline) {
+		submitInfo
+			.setPNext(&timelineInfo)
+			.setSignalSemaphoreCount(1)
+			.setPSignalSemaphores(&_timeline);
+	}
+	_vkCtx.getTransferQueue(0).submit({ submitInfo }, submission.fence);
+
+	_inFlight.push_back(*_recording);
+	_recording.reset();
+	return submission.token;
+}
 
-	_vkCtx.getTransferQueue(0).submit({ submitInfo }, vk::Fence());
+void AsyncTransferHandler::reclaim()
+{
+	while (!_inFlight.empty()) {
+		auto& submission = _submissions[_inFlight.front()];
+		if (_vkCtx.getDevice().getFenceStatus(submission.fence) != vk::Result::eSuccess) {
+			break;
+		}
+		waitOldest();
+	}
+}
 
-	_vkCtx.getTransferQueue(0).waitIdle();
-	_commandBuffer.reset(vk::CommandBufferResetFlagBits());
+void AsyncTransferHandler::waitOldest()
+{
+	PROFILE_ZONE("AsyncTransferHandler::waitOldest");
+	size_t index = _inFlight.front();
+	auto& submission = _submissions[index];
+	_vkCtx.getDevice().waitForFences({ submission.fence }, true, UINT64_MAX);
+	_vkCtx.getDevice().resetFences({ submission.fence });
+
+	_inFlight.pop_front();
+	_freeSubmissions.push_back(index);
+	_completedToken = submission.token;
+	_tail = submission.end;
+	_empty = _tail == _head && !_recording;
 }
 
-void* AsyncTransferHandler::mapStagingBuffer()
+bool AsyncTransferHandler::isComplete(TransferToken token)
 {
-	return _vkCtx.getDevice().mapMemory(_stagingMemory, 0, _size);
+	reclaim();
+	return token <= _completedToken;
 }
 
-void AsyncTransferHandler::unmapStagingBuffer()
+void AsyncTransferHandler::wait(TransferToken token)
 {
-	_vkCtx.getDevice().unmapMemory(_stagingMemory);
+	if (_recording && token >= _submissions[*_recording].token) {
+		submit();
+	}
+	while (_completedToken < token && !_inFlight.empty()) {
+		waitOldest();
+	}
 }
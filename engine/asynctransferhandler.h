@@ -2,29 +2,89 @@
 
 #include "vulkancontext.h"
 
+#include <array>
+#include <deque>
+#include <optional>
+#include <span>
 
+
+// Identifies a transfer submission. Tokens increase with every submission, and a
+// token is complete once it and every earlier submission have finished.
+using TransferToken = uint64_t;
+
+struct TransferSubmission {
+	vk::CommandBuffer commandBuffer;
+	vk::Fence fence;
+	TransferToken token = 0;
+	// Ring position just past the last byte this submission staged.
+	size_t end = 0;
+};
+
+constexpr size_t defaultStagingSize = 16 << 20;
+
+// Streams buffer uploads through a persistently mapped staging ring on the transfer
+// queue. Staged bytes are reclaimed as the fences of their submissions signal, so
+// callers only block when the ring or every command buffer is in flight.
+//
+// Every submission signals its token on a timeline semaphore when the device has
+// them, so the graphics queue can wait for uploads on the GPU. No queue family
+// ownership is transferred: destinations used on other queues must be created with
+// concurrent sharing across the transfer family and theirs.
 class AsyncTransferHandler
 {
+	static constexpr size_t submissionCount = 4;
+	// Transfers are staged in chunks of at most 1/chunkDivisor of the ring, so the GPU
+	// copies one chunk while the next is being staged.
+	static constexpr size_t chunkDivisor = 4;
+	static constexpr size_t stagingAlignment = 16;
+
 	const VulkanContext& _vkCtx;
 	vk::CommandPool _commandPool;
-	vk::CommandBuffer _commandBuffer;
-	vk::Buffer _stagingBuffer;
-	vk::DeviceMemory _stagingMemory;
-	uint8_t* _data;
-
-	size_t _pos;
+	vk::Semaphore _timeline;
+	uint32_t _srcFamily;
+	Buffer<uint8_t> _staging;
+	uint8_t* _data = nullptr;
 	size_t _size;
+
+	// Staged bytes occupy [_tail, _head), wrapping around the end of the ring.
+	size_t _head = 0;
+	size_t _tail = 0;
+	bool _empty = true;
+
+	std::array<TransferSubmission, submissionCount> _submissions;
+	std::deque<size_t> _freeSubmissions;
+	std::deque<size_t> _inFlight;
+	std::optional<size_t> _recording;
+	TransferToken _nextToken = 1;
+	TransferToken _completedToken = 0;
+
+	size_t allocate(size_t size);
+	TransferSubmission& getRecording();
+	void waitOldest();
 public:
-	AsyncTransferHandler(const VulkanContext& vkCtx);
+	AsyncTransferHandler(const VulkanContext& vkCtx, size_t stagingSize = defaultStagingSize);
+	AsyncTransferHandler(const AsyncTransferHandler&) = delete;
+	~AsyncTransferHandler();
 
-	size_t getPos() const;
 	size_t getSize() const;
+	// Signaled with each token as its submission completes, or null without timeline semaphore support.
+	vk::Semaphore getTimeline() const;
 
-	bool canFit(size_t size) const;
-	void beginTransferCommand();
-	void addTransfer(const void* data, size_t size, vk::Buffer dstBuffer);
-	void resetAndSubmitPool();
+	// Copies data into the ring and records a copy into dstBuffer at dstOffset. Data
+	// of any size is accepted; large transfers are split into chunks, each submitted
+	// as soon as it is staged. Submits the batch being recorded on its own if the
+	// ring has no room left.
+	void addTransfer(const void* data, size_t size, vk::Buffer dstBuffer, vk::DeviceSize dstOffset = 0);
+	template<class T>
+	void addTransfer(std::span<const T> data, vk::Buffer dstBuffer, vk::DeviceSize dstOffset = 0) {
+		addTransfer(data.data(), data.size_bytes(), dstBuffer, dstOffset);
+	}
+	// Submits everything recorded so far. The returned token covers all transfers
+	// added before this call.
+	TransferToken submit();
 
-	void* mapStagingBuffer();
-	void unmapStagingBuffer();
+	// Reclaims the ring space of finished submissions without blocking.
+	void reclaim();
+	bool isComplete(TransferToken token);
+	void wait(TransferToken token);
 };
@@ -0,0 +1,298 @@
+#include "benchmark.h"
+
+#include "cpuprofiler.h"
+#include "gamestate.h"
+#include "latencyhistogram.h"
+#include "renderer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+static void fillInstanceGrid(GraphicsObjectState& object, size_t count, float spacing)
+{
+	int side = (int)std::ceil(std::cbrt((double)count));
+	object.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 pos = {
+			(float)((int)(i % side) - side / 2) * spacing,
+			(float)((int)((i / side) % side)) * spacing,
+			(float)((int)(i / (side * side))) * spacing
+		};
+		glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+		object.setInstance(i, pos, rotation, pos, rotation);
+	}
+}
+
+void runHeadless(const EngineOptions& options)
+{
+	JobSystem jobs;
+	VulkanContext vkCtx;
+	GameState gameState;
+	Renderer renderer(vkCtx, jobs, options.width, options.height, options.stagingSize, options.vertexFormat, options.pipelineCachePath);
+	if (options.recordThreads > 0) {
+		renderer.setRecordThreads(options.recordThreads);
+	}
+	renderer.setCullMode(options.cullMode);
+	renderer.setLodEnabled(options.lods);
+	renderer.setDynamicResolution(options.resolutionBudget, options.minResolutionScale);
+	const PipelineCacheStats& pipelineStats = renderer.getPipelineCacheStats();
+	std::cout << "pipelines: " << pipelineStats.pipelines << " created in " << pipelineStats.creationMs << " ms"
+		<< ", cache loaded " << pipelineStats.loadedBytes << " bytes" << std::endl;
+
+	gameState.loadFromFile(renderer, jobs, options.scene);
+
+	GraphicsGameState graphicsState;
+	gameState.initGraphicsGameState(graphicsState);
+	gameState.updateGraphicsGameState(graphicsState);
+
+	std::cout << "headless: " << vkCtx.getPhysicalDevice().getProperties().deviceName << " " << options.width << "x" << options.height << std::endl;
+
+	LatencyHistogram renderTimes(std::chrono::duration<float, std::milli>(options.hitchMs));
+	LatencyHistogram frameIntervals(std::chrono::duration<float, std::milli>(options.hitchMs));
+	auto start = std::chrono::high_resolution_clock::now();
+	auto reportStart = start;
+	auto lastFrame = start;
+	int reportFrames = 0;
+	int frame = 0;
+	for (; options.frames <= 0 || frame < options.frames; frame++) {
+		renderer.drawFrame(graphicsState);
+		reportFrames++;
+
+		auto now = std::chrono::high_resolution_clock::now();
+		renderTimes.record(std::chrono::duration<float, std::milli>(renderer.getFrameStats().cpuTime));
+		frameIntervals.record(now - lastFrame);
+		lastFrame = now;
+		std::chrono::duration<double> interval = now - reportStart;
+		if (interval.count() >= 1.0) {
+			const FrameStats& stats = renderer.getFrameStats();
+			std::cout << "headless: " << reportFrames / interval.count() << " frames/sec"
+				<< ", visible " << stats.instances
+				<< ", culled " << stats.culledInstances
+				<< ", gpu ms " << stats.gpuTime
+				<< ", resolution scale " << stats.resolutionScale << std::endl;
+			reportStart = now;
+			reportFrames = 0;
+		}
+	}
+	vkCtx.getDevice().waitIdle();
+
+	std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - start;
+	std::cout << "headless: " << frame << " frames in " << total.count() << " s, "
+		<< frame / total.count() << " frames/sec, "
+		<< total.count() * 1000.0 / frame << " ms/frame" << std::endl;
+	renderTimes.report(std::cout, "render cpu");
+	frameIntervals.report(std::cout, "frame interval");
+	for (const GpuRegionTiming& timing : renderer.getGpuProfiler().getTimings()) {
+		std::cout << "gpu " << timing.name << ": " << timing.averageMs << " ms average, " << timing.lastMs << " ms last" << std::endl;
+	}
+	if (!options.tracePath.empty()) {
+		dumpChromeTrace(options.tracePath);
+	}
+	if (options.cullMode == CullMode::GpuVerify) {
+		const CullVerification& verification = *renderer.getCullVerification();
+		std::cout << "gpu cull verify: " << verification.frames << " frames checked, "
+			<< verification.mismatchedFrames << " mismatched frames, "
+			<< verification.mismatchedObjects << " mismatched objects" << std::endl;
+	}
+
+	gameState.destroy(renderer);
+}
+
+void runInstancingBenchmark(const EngineOptions& options)
+{
+	JobSystem jobs;
+	VulkanContext vkCtx;
+	GameState gameState;
+	Renderer renderer(vkCtx, jobs, options.width, options.height, options.stagingSize, options.vertexFormat, options.pipelineCachePath);
+	renderer.setCullMode(options.cullMode);
+
+	gameState.loadFromFile(renderer, jobs, options.scene);
+
+	GraphicsGameState graphicsState;
+	gameState.initGraphicsGameState(graphicsState);
+	gameState.updateGraphicsGameState(graphicsState);
+
+	GraphicsObjectState object = graphicsState.objects.back();
+	graphicsState.objects = { object };
+
+	for (size_t count : { 1000, 10000, 100000 }) {
+		fillInstanceGrid(graphicsState.objects[0], count, 3.0f);
+
+		for (int i = 0; i < maxFramesInFlight; i++) {
+			renderer.drawFrame(graphicsState);
+		}
+
+		// --frames 0 means no limit for headless runs; measure at least one frame here.
+		int frames = std::max(options.frames, 1);
+		double cpuTime = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < frames; i++) {
+			renderer.drawFrame(graphicsState);
+			cpuTime += renderer.getFrameStats().cpuTime;
+		}
+		vkCtx.getDevice().waitIdle();
+		std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - start;
+
+		std::cout << "instances: " << count
+			<< ", visible: " << renderer.getFrameStats().instances
+			<< ", culled: " << renderer.getFrameStats().culledInstances
+			<< ", draw calls: " << renderer.getFrameStats().drawCalls
+			<< ", cpu ms/frame: " << cpuTime / frames
+			<< ", frames/sec: " << frames / total.count() << std::endl;
+	}
+
+	gameState.destroy(renderer);
+}
+
+void runLodBenchmark(const EngineOptions& options)
+{
+	JobSystem jobs;
+	VulkanContext vkCtx;
+	GameState gameState;
+	Renderer renderer(vkCtx, jobs, options.width, options.height, options.stagingSize, options.vertexFormat, options.pipelineCachePath);
+	renderer.setCullMode(options.cullMode);
+
+	gameState.loadFromFile(renderer, jobs, options.scene);
+
+	GraphicsGameState graphicsState;
+	gameState.initGraphicsGameState(graphicsState);
+	gameState.updateGraphicsGameState(graphicsState);
+
+	// A wide, deep grid so most visible instances are far enough away to drop levels.
+	GraphicsObjectState object = graphicsState.objects.back();
+	graphicsState.objects = { object };
+	fillInstanceGrid(graphicsState.objects[0], 100000, 20.0f);
+
+	for (bool lods : { false, true }) {
+		renderer.setLodEnabled(lods);
+		for (int i = 0; i < maxFramesInFlight; i++) {
+			renderer.drawFrame(graphicsState);
+		}
+
+		uint64_t triangles = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < options.frames; i++) {
+			renderer.drawFrame(graphicsState);
+			triangles += renderer.getFrameStats().triangles;
+		}
+		vkCtx.getDevice().waitIdle();
+		std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - start;
+
+		std::cout << "lod " << (lods ? "on" : "off")
+			<< ": visible: " << renderer.getFrameStats().instances
+			<< ", triangles/frame: " << triangles / std::max(options.frames, 1)
+			<< ", frames/sec: " << options.frames / total.count() << std::endl;
+	}
+
+	gameState.destroy(renderer);
+}
+
+void runRecordingBenchmark(const EngineOptions& options)
+{
+	JobSystem jobs;
+	VulkanContext vkCtx;
+	GameState gameState;
+	Renderer renderer(vkCtx, jobs, options.width, options.height, options.stagingSize, options.vertexFormat, options.pipelineCachePath);
+
+	gameState.loadFromFile(renderer, jobs, options.scene);
+
+	GraphicsGameState graphicsState;
+	gameState.initGraphicsGameState(graphicsState);
+	gameState.updateGraphicsGameState(graphicsState);
+
+	GraphicsObjectState object = graphicsState.objects.back();
+	fillInstanceGrid(object, 2, 3.0f);
+	graphicsState.objects.assign(20000, object);
+	for (size_t i = 0; i < graphicsState.objects.size(); i++) {
+		auto& placed = graphicsState.objects[i];
+		for (size_t k = 0; k < placed.getInstanceCount(); k++) {
+			placed.current.posY[k] += (float)(i / 100) * 3.0f;
+			placed.current.posZ[k] += (float)(i % 100) * 3.0f;
+		}
+		placed.previous = placed.current;
+	}
+
+	double baseline = 0;
+	for (size_t threads = 1; threads <= renderer.getMaxRecordThreads(); threads++) {
+		renderer.setRecordThreads(threads);
+
+		for (int i = 0; i < maxFramesInFlight; i++) {
+			renderer.drawFrame(graphicsState);
+		}
+
+		// --frames 0 means no limit for headless runs; measure at least one frame here.
+		int frames = std::max(options.frames, 1);
+		double cpuTime = 0;
+		for (int i = 0; i < frames; i++) {
+			renderer.drawFrame(graphicsState);
+			cpuTime += renderer.getFrameStats().cpuTime;
+		}
+		cpuTime /= frames;
+		if (threads == 1) {
+			baseline = cpuTime;
+		}
+
+		std::cout << "record threads: " << threads
+			<< ", objects: " << graphicsState.objects.size()
+			<< ", draw calls: " << renderer.getFrameStats().drawCalls
+			<< ", cpu ms/frame: " << cpuTime
+			<< ", speedup: " << baseline / cpuTime << std::endl;
+	}
+	vkCtx.getDevice().waitIdle();
+
+	gameState.destroy(renderer);
+}
+
+void runUploadBenchmark(const EngineOptions& options)
+{
+	constexpr int repeats = 8;
+
+	VulkanContext vkCtx;
+	AsyncTransferHandler transferHandler(vkCtx, options.stagingSize);
+
+	// Several times the ring, so every upload is chunked and the ring wraps.
+	size_t size = transferHandler.getSize() * 8;
+	std::vector<uint32_t> data(size / sizeof(uint32_t));
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = (uint32_t)i * 2654435761u;
+	}
+
+	Buffer<uint8_t> target(vkCtx, size, vk::BufferUsageFlagBits::eTransferDst);
+	transferHandler.addTransfer(data.data(), size, target.data);
+	transferHandler.wait(transferHandler.submit());
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < repeats; i++) {
+		transferHandler.addTransfer(data.data(), size, target.data);
+	}
+	transferHandler.wait(transferHandler.submit());
+	std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - start;
+
+	std::cout << "upload: " << (size >> 20) << " MiB x " << repeats
+		<< " through " << (transferHandler.getSize() >> 20) << " MiB staging in " << total.count() * 1000.0 << " ms, "
+		<< size * repeats / total.count() / 1e9 << " GB/s" << std::endl;
+
+	Buffer<uint8_t> readback(vkCtx, size, vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU);
+	transferHandler.addTransfer(data.data(), size, readback.data);
+	transferHandler.wait(transferHandler.submit());
+
+	void* mapped;
+	vmaMapMemory(vkCtx.getAllocator(), readback.allocation, &mapped);
+	vmaInvalidateAllocation(vkCtx.getAllocator(), readback.allocation, 0, VK_WHOLE_SIZE);
+	bool matches = memcmp(mapped, data.data(), size) == 0;
+	vmaUnmapMemory(vkCtx.getAllocator(), readback.allocation);
+
+	readback.destroy(vkCtx);
+	target.destroy(vkCtx);
+	if (!matches) {
+		throw std::runtime_error("upload: readback does not match the uploaded data");
+	}
+	std::cout << "upload: readback verified" << std::endl;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "options.h"
+
+
+void runHeadless(const EngineOptions& options);
+void runInstancingBenchmark(const EngineOptions& options);
+void runLodBenchmark(const EngineOptions& options);
+void runRecordingBenchmark(const EngineOptions& options);
+void runUploadBenchmark(const EngineOptions& options);
@@ -0,0 +1,159 @@
+#include "cpuprofiler.h"
+
+#include <iostream>
+
+#ifdef ENGINE_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Relaxed atomics so a trace can read a slot while its thread overwrites it.
+struct Zone {
+	std::atomic<const char*> name;
+	std::atomic<uint64_t> begin;
+	std::atomic<uint64_t> end;
+};
+
+struct ThreadZones {
+	uint32_t id = 0;
+	// Guarded by registryMutex.
+	std::string name;
+	std::unique_ptr<Zone[]> zones{ new Zone[cpuZoneCapacity] };
+	// Zones written so far. Only the owning thread writes.
+	std::atomic<uint64_t> count = 0;
+};
+
+struct CopiedZone {
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+const std::chrono::steady_clock::time_point profileEpoch = std::chrono::steady_clock::now();
+
+std::mutex registryMutex;
+// Never freed, so a trace still includes threads that have exited.
+std::vector<ThreadZones*> registry;
+
+ThreadZones& getThreadZones()
+{
+	thread_local ThreadZones* zones = [] {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto* created = new ThreadZones();
+		created->id = (uint32_t)registry.size();
+		created->name = "thread " + std::to_string(created->id);
+		registry.push_back(created);
+		return created;
+	}();
+	return *zones;
+}
+
+void writeEscaped(std::ostream& out, const char* text)
+{
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\') {
+			out << '\\';
+		}
+		out << *text;
+	}
+}
+
+}
+
+uint64_t getProfileTime()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileEpoch).count();
+}
+
+void recordZone(const char* name, uint64_t begin, uint64_t end)
+{
+	ThreadZones& thread = getThreadZones();
+	uint64_t n = thread.count.load(std::memory_order_relaxed);
+	Zone& zone = thread.zones[n % cpuZoneCapacity];
+	zone.name.store(name, std::memory_order_relaxed);
+	zone.begin.store(begin, std::memory_order_relaxed);
+	zone.end.store(end, std::memory_order_relaxed);
+	thread.count.store(n + 1, std::memory_order_release);
+}
+
+void setProfileThreadName(const std::string& name)
+{
+	ThreadZones& thread = getThreadZones();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	thread.name = name;
+}
+
+bool writeChromeTrace(const std::string& fileName)
+{
+	std::ofstream file(fileName, std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+	file.setf(std::ios::fixed);
+	file.precision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	bool first = true;
+	std::vector<CopiedZone> copied;
+	for (ThreadZones* thread : registry) {
+		file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->id << ",\"args\":{\"name\":\"";
+		writeEscaped(file, thread->name.c_str());
+		file << "\"}}";
+		first = false;
+
+		uint64_t end = thread->count.load(std::memory_order_acquire);
+		uint64_t begin = end > cpuZoneCapacity ? end - cpuZoneCapacity : 0;
+		copied.clear();
+		for (uint64_t n = begin; n < end; n++) {
+			const Zone& zone = thread->zones[n % cpuZoneCapacity];
+			copied.push_back({ zone.name.load(std::memory_order_relaxed), zone.begin.load(std::memory_order_relaxed), zone.end.load(std::memory_order_relaxed) });
+		}
+		// The thread may have lapped the copy, and may be halfway through overwriting
+		// the slot after its latest zone.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t written = thread->count.load(std::memory_order_relaxed);
+		uint64_t valid = written + 1 > cpuZoneCapacity ? written + 1 - cpuZoneCapacity : 0;
+
+		for (uint64_t n = std::max(begin, valid); n < end; n++) {
+			const CopiedZone& zone = copied[n - begin];
+			file << ",\n{\"name\":\"";
+			writeEscaped(file, zone.name);
+			file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread->id
+				<< ",\"ts\":" << zone.begin / 1000.0
+				<< ",\"dur\":" << (zone.end - zone.begin) / 1000.0 << "}";
+		}
+	}
+	file << "\n]}\n";
+	return (bool)file;
+}
+
+#else
+
+bool writeChromeTrace(const std::string&)
+{
+	return false;
+}
+
+#endif
+
+void dumpChromeTrace([[maybe_unused]] const std::string& fileName)
+{
+#ifdef ENGINE_PROFILE
+	if (writeChromeTrace(fileName)) {
+		std::cout << "trace: wrote " << fileName << std::endl;
+	}
+	else {
+		std::cerr << "trace: failed to write " << fileName << std::endl;
+	}
+#else
+	std::cerr << "trace: not written, CPU profiling needs a build with ENGINE_PROFILE" << std::endl;
+#endif
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+// Scoped CPU zones, recorded only when built with ENGINE_PROFILE. Otherwise the
+// macros expand to nothing and writeChromeTrace reports that there is no trace.
+//
+// Each thread appends zones to its own ring buffer without locks, keeping the most
+// recent cpuZoneCapacity; writeChromeTrace can run at any time from any thread and
+// skips zones overwritten while it was copying them.
+#ifdef ENGINE_PROFILE
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// name must be a string literal or otherwise outlive the trace.
+#define PROFILE_ZONE(name) CpuZone PROFILE_CONCAT(cpuZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) setProfileThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(name)
+
+#endif
+
+constexpr size_t cpuZoneCapacity = 1 << 16;
+
+#ifdef ENGINE_PROFILE
+
+uint64_t getProfileTime();
+void recordZone(const char* name, uint64_t begin, uint64_t end);
+void setProfileThreadName(const std::string& name);
+
+class CpuZone
+{
+	const char* const _name;
+	const uint64_t _begin;
+
+public:
+	CpuZone(const char* name) : _name(name), _begin(getProfileTime()) {}
+	CpuZone(const CpuZone&) = delete;
+	~CpuZone() { recordZone(_name, _begin, getProfileTime()); }
+};
+
+#endif
+
+// Writes every thread's recorded zones as Chrome trace event JSON, which
+// chrome://tracing and Perfetto open. Returns false when profiling is compiled out
+// or the file cannot be written.
+bool writeChromeTrace(const std::string& fileName);
+// writeChromeTrace, reporting the outcome on the console.
+void dumpChromeTrace(const std::string& fileName);
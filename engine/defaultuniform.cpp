@@ -1,5 +1,7 @@
 #include "defaultuniform.h"
 
+#include <algorithm>
+
 DefaultUniformLayout::DefaultUniformLayout(const VulkanContext& vkCtx, int count) : _vkCtx(vkCtx)
 {
 	auto sceneLayoutBinding = vk::DescriptorSetLayoutBinding()
@@ -16,7 +18,7 @@ DefaultUniformLayout::DefaultUniformLayout(const VulkanContext& vkCtx, int count
 	auto modelLayoutBinding = vk::DescriptorSetLayoutBinding()
 		.setBinding(0)
 		.setDescriptorCount(1)
-		.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+		.setDescriptorType(vk::DescriptorType::eStorageBuffer)
 		.setStageFlags(vk::ShaderStageFlagBits::eVertex);
 
 	auto modelLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
@@ -28,7 +30,7 @@ DefaultUniformLayout::DefaultUniformLayout(const VulkanContext& vkCtx, int count
 	vk::DescriptorPoolSize descriptorPoolSize[] = {
 		vk::DescriptorPoolSize()
 			.setDescriptorCount(count)
-			.setType(vk::DescriptorType::eUniformBufferDynamic),
+			.setType(vk::DescriptorType::eStorageBuffer),
 		vk::DescriptorPoolSize()
 			.setDescriptorCount(count)
 			.setType(vk::DescriptorType::eUniformBuffer)
@@ -37,7 +39,7 @@ DefaultUniformLayout::DefaultUniformLayout(const VulkanContext& vkCtx, int count
 	auto descriptorPoolInfo = vk::DescriptorPoolCreateInfo()
 		.setMaxSets(2 * count)
 		.setPPoolSizes(descriptorPoolSize)
-		.setPoolSizeCount(1);
+		.setPoolSizeCount(2);
 
 	_descriptorPool = vkCtx.getDevice().createDescriptorPool(descriptorPoolInfo);
 	_sceneUniforms.resize(count);
@@ -47,22 +49,9 @@ DefaultUniformLayout::DefaultUniformLayout(const VulkanContext& vkCtx, int count
 		auto& modelUniform = _modelUniforms[i];
 		auto& sceneUniform = _sceneUniforms[i];
 
-		modelUniform = Uniform<ModelUniform, 256>(vkCtx, 128, _descriptorPool, _modelLayout);
+		modelUniform = Uniform<ModelUniform>(vkCtx, initialModelCapacity, _descriptorPool, _modelLayout, vk::BufferUsageFlagBits::eStorageBuffer);
 		sceneUniform = Uniform<SceneUniform>(vkCtx, 1, _descriptorPool, _sceneLayout);
 
-		auto modelDescBufferInfo = vk::DescriptorBufferInfo()
-			.setBuffer(modelUniform.buffer.data)
-			.setOffset(0)
-			.setRange(vk::DeviceSize(sizeof(ModelUniform)));
-
-		auto modelWriteInfo = vk::WriteDescriptorSet()
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
-			.setDstBinding(0)
-			.setDstArrayElement(0)
-			.setDstSet(modelUniform.descriptor)
-			.setPBufferInfo(&modelDescBufferInfo);
-
 		auto sceneDescBufferInfo = vk::DescriptorBufferInfo()
 			.setBuffer(sceneUniform.buffer.data)
 			.setOffset(0)
@@ -76,10 +65,31 @@ DefaultUniformLayout::DefaultUniformLayout(const VulkanContext& vkCtx, int count
 			.setDstSet(sceneUniform.descriptor)
 			.setPBufferInfo(&sceneDescBufferInfo);
 
-		vkCtx.getDevice().updateDescriptorSets({ sceneWriteInfo, modelWriteInfo }, {});
+		vkCtx.getDevice().updateDescriptorSets({ sceneWriteInfo }, {});
+		writeModelDescriptor(i);
 	}
 }
 
+void DefaultUniformLayout::writeModelDescriptor(int frame)
+{
+	const auto& modelUniform = _modelUniforms[frame];
+
+	auto modelDescBufferInfo = vk::DescriptorBufferInfo()
+		.setBuffer(modelUniform.buffer.data)
+		.setOffset(0)
+		.setRange(VK_WHOLE_SIZE);
+
+	auto modelWriteInfo = vk::WriteDescriptorSet()
+		.setDescriptorCount(1)
+		.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+		.setDstBinding(0)
+		.setDstArrayElement(0)
+		.setDstSet(modelUniform.descriptor)
+		.setPBufferInfo(&modelDescBufferInfo);
+
+	_vkCtx.getDevice().updateDescriptorSets({ modelWriteInfo }, {});
+}
+
 
 vk::DescriptorSetLayout DefaultUniformLayout::getSceneLayout()
 {
@@ -98,7 +108,24 @@ size_t DefaultUniformLayout::getSceneUniformSize() const
 
 size_t DefaultUniformLayout::getModelUniformSize() const
 {
-	return Uniform<ModelUniform, 256>::getMinPadding();
+	return sizeof(ModelUniform);
+}
+
+size_t DefaultUniformLayout::getModelCapacity(int frame) const
+{
+	return _modelUniforms[frame].buffer.size;
+}
+
+void DefaultUniformLayout::reserveModelUniforms(int frame, size_t count)
+{
+	auto& modelUniform = _modelUniforms[frame];
+	if (count <= modelUniform.buffer.size) {
+		return;
+	}
+
+	size_t capacity = std::max(count, modelUniform.buffer.size * 2);
+	modelUniform.reallocate(_vkCtx, capacity, vk::BufferUsageFlagBits::eStorageBuffer);
+	writeModelDescriptor(frame);
 }
 
 std::vector<Uniform<SceneUniform>>& DefaultUniformLayout::getSceneUniforms()
@@ -106,7 +133,7 @@ std::vector<Uniform<SceneUniform>>& DefaultUniformLayout::getSceneUniforms()
 	return _sceneUniforms;
 }
 
-std::vector<Uniform<ModelUniform, 256>>& DefaultUniformLayout::getModelUniforms()
+std::vector<Uniform<ModelUniform>>& DefaultUniformLayout::getModelUniforms()
 {
 	return _modelUniforms;
 }
@@ -10,8 +10,8 @@ struct Uniform {
 	vk::DescriptorSet descriptor;
 	void* data;
 	Uniform() = default;
-	Uniform(const VulkanContext& vkCtx, size_t size, vk::DescriptorPool pool, vk::DescriptorSetLayout layout) :
-		buffer(vkCtx, size, vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU) {
+	Uniform(const VulkanContext& vkCtx, size_t size, vk::DescriptorPool pool, vk::DescriptorSetLayout layout, vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eUniformBuffer) :
+		buffer(vkCtx, size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU) {
 		auto sceneDescriptorAllocInfo = vk::DescriptorSetAllocateInfo()
 			.setDescriptorPool(pool)
 			.setDescriptorSetCount(1)
@@ -21,6 +21,13 @@ struct Uniform {
 		vmaMapMemory(vkCtx.getAllocator(), buffer.allocation, &data);
 	}
 
+	void reallocate(const VulkanContext& vkCtx, size_t size, vk::BufferUsageFlags usage) {
+		vmaUnmapMemory(vkCtx.getAllocator(), buffer.allocation);
+		buffer.destroy(vkCtx);
+		buffer = Buffer<T, minPadding>(vkCtx, size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		vmaMapMemory(vkCtx.getAllocator(), buffer.allocation, &data);
+	}
+
 	static size_t getMinPadding() {
 		return minPadding;
 	}
@@ -38,6 +45,8 @@ struct ModelUniform {
 	glm::mat4 modelTrans;
 };
 
+constexpr size_t initialModelCapacity = 128;
+
 
 class DefaultUniformLayout
 {
@@ -46,9 +55,11 @@ class DefaultUniformLayout
 	vk::DescriptorSetLayout _modelLayout;
 
 	std::vector<Uniform<SceneUniform>> _sceneUniforms;
-	std::vector<Uniform<ModelUniform, 256>> _modelUniforms;
+	std::vector<Uniform<ModelUniform>> _modelUniforms;
 
 	vk::DescriptorPool _descriptorPool;
+
+	void writeModelDescriptor(int frame);
 public:
 	DefaultUniformLayout(const VulkanContext& vkCtx, int count);
 
@@ -57,8 +68,10 @@ public:
 
 	size_t getSceneUniformSize() const;
 	size_t getModelUniformSize() const;
+	size_t getModelCapacity(int frame) const;
+	void reserveModelUniforms(int frame, size_t count);
 	std::vector<Uniform<SceneUniform>>& getSceneUniforms();
-	std::vector<Uniform<ModelUniform, 256>>& getModelUniforms();
+	std::vector<Uniform<ModelUniform>>& getModelUniforms();
 	~DefaultUniformLayout();
 };
 
@@ -0,0 +1,53 @@
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Weight of the newest frame in the smoothed GPU time.
+static constexpr float smoothing = 0.1f;
+// Fraction of the budget the controller aims for, leaving room for variance.
+static constexpr float targetFraction = 0.9f;
+// The scale grows only while the smoothed time is below this fraction of the target.
+static constexpr float raiseFraction = 0.8f;
+static constexpr float maxRaise = 0.02f;
+static constexpr float maxDrop = 0.15f;
+
+DynamicResolution::DynamicResolution(float budgetMs, float minScale) :
+	_budgetMs(budgetMs),
+	_minScale(std::clamp(minScale, 0.1f, 1.0f))
+{
+}
+
+float DynamicResolution::update(float gpuMs)
+{
+	_averageMs = _averageMs == 0.0f ? gpuMs : _averageMs + (gpuMs - _averageMs) * smoothing;
+
+	float targetMs = _budgetMs * targetFraction;
+	if (gpuMs > targetMs) {
+		float ideal = _scale * std::sqrt(targetMs / gpuMs);
+		_scale = std::max(ideal, _scale - maxDrop);
+	}
+	else if (_averageMs < targetMs * raiseFraction) {
+		float ideal = _scale * std::sqrt(targetMs / _averageMs);
+		_scale = std::min(ideal, _scale + maxRaise);
+	}
+	_scale = std::clamp(_scale, _minScale, 1.0f);
+	return _scale;
+}
+
+float DynamicResolution::getScale() const
+{
+	return _scale;
+}
+
+float DynamicResolution::getBudget() const
+{
+	return _budgetMs;
+}
+
+vk::Extent2D DynamicResolution::getExtent(vk::Extent2D full) const
+{
+	return vk::Extent2D(
+		std::max(1u, (uint32_t)std::lround(full.width * _scale)),
+		std::max(1u, (uint32_t)std::lround(full.height * _scale)));
+}
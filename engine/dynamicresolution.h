@@ -0,0 +1,29 @@
+#pragma once
+
+#include "vulkancontext.h"
+
+
+constexpr float defaultMinResolutionScale = 0.5f;
+
+// Picks the fraction of the output resolution the scene is rendered at from
+// measured GPU frame times, assuming GPU time scales with the pixel count. A frame
+// over the budget lowers the scale for the next one straight away, so load spikes
+// cost resolution rather than frames; the scale only climbs back once the smoothed
+// time has stayed comfortably under the budget.
+class DynamicResolution
+{
+	const float _budgetMs;
+	const float _minScale;
+	float _scale = 1.0f;
+	float _averageMs = 0.0f;
+
+public:
+	DynamicResolution(float budgetMs, float minScale = defaultMinResolutionScale);
+
+	// Feeds the GPU time of a finished frame and returns the new scale.
+	float update(float gpuMs);
+	float getScale() const;
+	float getBudget() const;
+	// The scaled extent, at least one pixel on each side.
+	vk::Extent2D getExtent(vk::Extent2D full) const;
+};
@@ -1,7 +1,14 @@
 ﻿#define WIN32_LEAN_AND_MEAN
 
+#include "benchmark.h"
+#include "cpuprofiler.h"
 #include "gamestate.h"
+#include "jobsystem.h"
+#include "latencyhistogram.h"
+#include "options.h"
 #include "renderer.h"
+#include "snapshotexchange.h"
+#include "timestep.h"
 
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -14,6 +21,8 @@
 #include <atomic>
 #include <iostream>
 #include <chrono>
+#include <functional>
+#include <mutex>
 #include <thread>
 
 using namespace std::literals::chrono_literals;
@@ -26,20 +35,54 @@ constexpr bool debug = false;
 constexpr bool debug = true;
 #endif
 
-int main()
+int main(int argc, char** argv)
 {
 	unsigned windowFlags = SDL_WINDOW_VULKAN;
+	PROFILE_THREAD("main");
 	try {
-		SDL_Window* window = SDL_CreateWindow("Bruh", 500, 500, 800, 600, windowFlags);
+		EngineOptions options = EngineOptions::parse(argc, argv);
+		if (options.benchInstances) {
+			runInstancingBenchmark(options);
+			return 0;
+		}
+		if (options.benchRecording) {
+			runRecordingBenchmark(options);
+			return 0;
+		}
+		if (options.benchUpload) {
+			runUploadBenchmark(options);
+			return 0;
+		}
+		if (options.benchLod) {
+			runLodBenchmark(options);
+			return 0;
+		}
+		if (options.headless) {
+			runHeadless(options);
+			return 0;
+		}
+
+		SDL_Window* window = SDL_CreateWindow("Bruh", 500, 500, options.width, options.height, windowFlags);
 		SDL_SetWindowBordered(window, SDL_TRUE);
 		SDL_SetRelativeMouseMode(SDL_TRUE);
 
+		JobSystem jobs;
 		VulkanContext vkCtx(window);
 		GameState gameState;
 		Physics physics;
-		Renderer renderer(vkCtx, window);
+		Renderer renderer(vkCtx, jobs, window, options.stagingSize, options.vertexFormat, options.pipelineCachePath);
+		if (options.recordThreads > 0) {
+			renderer.setRecordThreads(options.recordThreads);
+		}
+		renderer.setCullMode(options.cullMode);
+		renderer.setLodEnabled(options.lods);
+		renderer.setDynamicResolution(options.resolutionBudget, options.minResolutionScale);
+		const PipelineCacheStats& pipelineStats = renderer.getPipelineCacheStats();
+		std::cout << "pipelines: " << pipelineStats.pipelines << " created in " << pipelineStats.creationMs << " ms"
+			<< ", cache loaded " << pipelineStats.loadedBytes << " bytes" << std::endl;
 
-		gameState.loadFromFile(renderer, "scenes/scene.json");
+		auto loadStart = std::chrono::high_resolution_clock::now();
+		std::shared_ptr<SceneLoad> load = gameState.loadFromFileAsync(renderer, jobs, options.scene);
 
 		for (Object& object : gameState.objects) {
 			for (DynamicObjectState& instance : object.instances) {
@@ -47,28 +90,79 @@ int main()
 			}
 		}
 		
-		std::array<GraphicsGameState, 2> gameStates;
-
-		std::atomic<int> selectedGamestate = 0;
-		gameState.initGraphicsGameState(gameStates[0]);
-		gameState.initGraphicsGameState(gameStates[1]);
-		gameState.updateGraphicsGameState(gameStates[0]);
-		gameState.updateGraphicsGameState(gameStates[1]);
+		SnapshotExchange<GraphicsGameState> snapshots(options.exchangeMode);
+		for (GraphicsGameState& state : snapshots.getBuffers()) {
+			gameState.initGraphicsGameState(state);
+			gameState.updateGraphicsGameState(state);
+		}
 
-		std::chrono::time_point last = std::chrono::high_resolution_clock::now();
+		FixedTimestep timestep(options.tickRate);
+		auto lastReport = std::chrono::high_resolution_clock::now();
 		
-		std::mutex mutex;
-		bool running = true;
+		std::atomic<bool> running = true;
+		std::atomic<uint32_t> visibleInstances = 0;
+		std::atomic<uint32_t> culledInstances = 0;
+		std::atomic<float> resolutionScale = 1.0f;
+
+		// Written by simulate jobs, which the main thread waits for before reading.
+		LatencyHistogram tickTimes(std::chrono::duration<float>(timestep.getTickDuration()));
+		// Guarded by frameTimesMutex.
+		std::mutex frameTimesMutex;
+		LatencyHistogram renderTimes(std::chrono::duration<float, std::milli>(options.hitchMs));
+		LatencyHistogram presentIntervals(std::chrono::duration<float, std::milli>(options.hitchMs));
+		auto reportFrameTimes = [&] {
+			tickTimes.report(std::cout, "sim tick");
+			std::lock_guard<std::mutex> lock(frameTimesMutex);
+			renderTimes.report(std::cout, "render cpu");
+			presentIntervals.report(std::cout, "present interval");
+		};
 
-		std::thread thread([&] {
-			while (true) {
-				renderer.drawFrame(gameStates[selectedGamestate], mutex);
+		std::thread renderThread([&] {
+			PROFILE_THREAD("render");
+			std::chrono::high_resolution_clock::time_point lastPresent;
+			bool presentedBefore = false;
+			while (running) {
+				snapshots.acquire();
+				renderer.drawFrame(snapshots.getFront());
+				auto presented = std::chrono::high_resolution_clock::now();
+				visibleInstances.store(renderer.getFrameStats().instances, std::memory_order_relaxed);
+				culledInstances.store(renderer.getFrameStats().culledInstances, std::memory_order_relaxed);
+				resolutionScale.store(renderer.getFrameStats().resolutionScale, std::memory_order_relaxed);
+
+				std::lock_guard<std::mutex> lock(frameTimesMutex);
+				renderTimes.record(std::chrono::duration<float, std::milli>(renderer.getFrameStats().cpuTime));
+				if (presentedBefore) {
+					presentIntervals.record(presented - lastPresent);
+				}
+				lastPresent = presented;
+				presentedBefore = true;
 			}
 		});
-		thread.detach();
+		// However the main loop is left, stop the render thread and let the decode jobs
+		// and the GPU finish with the renderer before it is destroyed, so an error such
+		// as a failed model load reaches the catch below instead of std::terminate.
+		struct ExitGuard {
+			std::function<void()> onExit;
+			~ExitGuard() { onExit(); }
+		} stopRendering{ [&] {
+			running = false;
+			if (renderThread.joinable()) {
+				renderThread.join();
+			}
+			load->waitDecoded(jobs);
+			try {
+				vkCtx.getDevice().waitIdle();
+			}
+			catch (const vk::SystemError&) {
+				// A lost device has nothing left to wait for.
+			}
+		} };
 		while (running) {
-			std::chrono::duration<float> delta = std::chrono::high_resolution_clock::now() - last;
-			last = std::chrono::high_resolution_clock::now();
+			if (!load->isFinished() && load->apply(gameState)) {
+				std::chrono::duration<double, std::milli> loadTime = std::chrono::high_resolution_clock::now() - loadStart;
+				std::cout << "scene: " << load->getModelCount() << " models loaded in " << loadTime.count() << " ms" << std::endl;
+			}
+
 			SDL_Event evt;
 			while (SDL_PollEvent(&evt)) {
 				if (evt.type == SDL_QUIT) {
@@ -85,6 +179,9 @@ int main()
 						SDL_SetWindowGrab(window, SDL_FALSE);
 						SDL_SetRelativeMouseMode(SDL_FALSE);
 					}
+					if (evt.key.keysym.scancode == SDL_SCANCODE_F9 && !options.tracePath.empty()) {
+						dumpChromeTrace(options.tracePath);
+					}
 				}
 				if (evt.type == SDL_MOUSEMOTION) {
 					gameState.cameraX -= evt.motion.xrel/1000.0;
@@ -112,16 +209,49 @@ int main()
 			if (keystate[SDL_SCANCODE_LCTRL]) {
 				cameraChange += glm::vec3{ 0, 0, -1 };
 			}
-			gameState.cameraPos += glm::vec3(gameState.getCameraMatrix() * glm::vec4(cameraChange * delta.count() * 2.0f, 0.0f));
-			mutex.lock();
-			gameState.updateGraphicsGameState(gameStates[selectedGamestate]);
-			selectedGamestate = !selectedGamestate;
-			mutex.unlock();
-			physics.stepPhysics(delta.count());
-			std::this_thread::sleep_for(50ms);
+
+			int ticks = timestep.advance();
+			if (ticks > 0) {
+				float dt = timestep.getTickDuration();
+				TaskHandle simulate = jobs.schedule([&] {
+					for (int i = 0; i < ticks; i++) {
+						auto tickStart = std::chrono::high_resolution_clock::now();
+						gameState.cameraPos += glm::vec3(gameState.getCameraMatrix() * glm::vec4(cameraChange * dt * 2.0f, 0.0f));
+						physics.stepPhysics(dt);
+						tickTimes.record(std::chrono::high_resolution_clock::now() - tickStart);
+					}
+				});
+				TaskHandle snapshot = jobs.schedule([&] { gameState.updateGraphicsGameState(snapshots.getBack(), dt * ticks); }, { simulate });
+				jobs.wait(snapshot);
+				snapshots.publish();
+			}
+
+			auto now = std::chrono::high_resolution_clock::now();
+			if (now - lastReport >= 5s) {
+				const ExchangeStats& stats = snapshots.getStats();
+				std::cout << "snapshots: published " << stats.published
+					<< ", dropped " << stats.dropped
+					<< ", acquired " << stats.acquired
+					<< ", stale frames " << stats.stale
+					<< ", producer us " << stats.producerNanoseconds / 1000
+					<< ", consumer us " << stats.consumerNanoseconds / 1000 << std::endl;
+				std::cout << "instances: visible " << visibleInstances.load(std::memory_order_relaxed)
+					<< ", culled " << culledInstances.load(std::memory_order_relaxed)
+					<< ", resolution scale " << resolutionScale.load(std::memory_order_relaxed) << std::endl;
+				reportFrameTimes();
+				lastReport = now;
+			}
+			std::this_thread::sleep_until(timestep.getNextTick());
 		}
 		
-		vkCtx.getDevice().waitIdle();
+		renderThread.join();
+		reportFrameTimes();
+		if (!options.tracePath.empty()) {
+			dumpChromeTrace(options.tracePath);
+		}
+		for (const GpuRegionTiming& timing : renderer.getGpuProfiler().getTimings()) {
+			std::cout << "gpu " << timing.name << ": " << timing.averageMs << " ms average, " << timing.lastMs << " ms last" << std::endl;
+		}
 	}
 	catch (std::exception& e) {
 		std::cout << e.what();
@@ -1,5 +1,7 @@
 #include "gamestate.h"
 
+#include "cpuprofiler.h"
+#include "jobsystem.h"
 #include "renderer.h"
 
 #include <glm/vec3.hpp>
@@ -9,23 +11,73 @@
 
 #include <rapidjson/document.h>
 
-glm::mat4 GameState::getCameraMatrix() const
+#include <algorithm>
+
+float GraphicsGameState::getInterpolation(std::chrono::high_resolution_clock::time_point time) const
+{
+	if (interval <= 0.0f) {
+		return 1.0f;
+	}
+	std::chrono::duration<float> elapsed = time - timeStamp;
+	return std::clamp(elapsed.count() / interval, 0.0f, 1.0f);
+}
+
+glm::mat4 getCameraMatrix(const CameraState& camera)
 {
-	glm::mat4 a = glm::rotate(glm::mat4(1.0f), cameraX, { 0.0f, 0.0f, 1.0f });
-	glm::mat4 b = glm::rotate(a, cameraY, { 1.0f, 0.0f, 0.0f });
-	glm::mat4 c = glm::translate(glm::mat4(1.0f), cameraPos);
+	glm::mat4 a = glm::rotate(glm::mat4(1.0f), camera.x, { 0.0f, 0.0f, 1.0f });
+	glm::mat4 b = glm::rotate(a, camera.y, { 1.0f, 0.0f, 0.0f });
+	glm::mat4 c = glm::translate(glm::mat4(1.0f), camera.pos);
 
 	return c * b;
 }
 
-void GameState::destroy(const VulkanContext& vkCtx)
+glm::mat4 getSceneMatrix(const CameraState& camera, float aspect)
 {
-	for (auto& object : objects) {
-		object.model.destroy(vkCtx);
+	glm::mat4 coordTransform = {
+		{1,  0,  0, 0},
+		{0,  0, -1, 0},
+		{0, -1,  0, 0},
+		{0,  0,  0, 1}
+	};
+	return glm::perspective(glm::radians(90.0f), aspect, 0.1f, 100.0f) * coordTransform * glm::inverse(getCameraMatrix(camera));
+}
+
+CameraState interpolate(const CameraState& a, const CameraState& b, float alpha)
+{
+	return { glm::mix(a.pos, b.pos, alpha), glm::mix(a.x, b.x, alpha), glm::mix(a.y, b.y, alpha) };
+}
+
+CameraState GameState::getCamera() const
+{
+	return { cameraPos, cameraX, cameraY };
+}
+
+glm::mat4 GameState::getCameraMatrix() const
+{
+	return ::getCameraMatrix(getCamera());
+}
+
+void GameState::destroy(Renderer& renderer)
+{
+	for (size_t i = 0; i < objects.size(); i++) {
+		const BakedModel& model = objects[i].model;
+		if (!model.isReady()) {
+			continue;
+		}
+		// Objects loaded from the same file share one allocation.
+		bool shared = std::any_of(objects.begin(), objects.begin() + i, [&](const Object& earlier) {
+			return earlier.model.isReady()
+				&& earlier.model.geometry.vertexOffset == model.geometry.vertexOffset
+				&& earlier.model.geometry.firstIndex == model.geometry.firstIndex
+				&& earlier.model.geometry.indexType == model.geometry.indexType;
+		});
+		if (!shared) {
+			renderer.releaseModel(model);
+		}
 	}
 }
 
-void GameState::loadFromFile(Renderer& renderer, std::string fileName)
+std::shared_ptr<SceneLoad> GameState::loadFromFileAsync(Renderer& renderer, JobSystem& jobs, const std::string& fileName)
 {
 	rapidjson::Document doc;
 
@@ -43,12 +95,24 @@ void GameState::loadFromFile(Renderer& renderer, std::string fileName)
 
 	doc.Parse(buffer.data(), buffer.size());
 
-	std::vector<Model> models;
-	models.reserve(doc["models"].GetArray().Size());
-	objects.reserve(doc["models"].GetArray().Size());
-	for (const auto& jsonModel : doc["models"].GetArray()) {
-		std::string fileName = jsonModel["file"].GetString();
-		models.push_back(Model::loadFromFile("models/" + fileName));
+	// Objects sharing a file load it once and share its geometry; loading it twice
+	// would also cook it twice at the same time.
+	const auto& jsonModels = doc["models"].GetArray();
+	std::vector<std::string> modelFiles;
+	std::vector<std::vector<size_t>> modelObjects;
+	for (rapidjson::SizeType i = 0; i < jsonModels.Size(); i++) {
+		std::string modelFile = jsonModels[i]["file"].GetString();
+		auto found = std::find(modelFiles.begin(), modelFiles.end(), modelFile);
+		if (found == modelFiles.end()) {
+			modelFiles.push_back(modelFile);
+			modelObjects.emplace_back();
+			found = modelFiles.end() - 1;
+		}
+		modelObjects[found - modelFiles.begin()].push_back(i);
+	}
+
+	objects.reserve(jsonModels.Size());
+	for (const auto& jsonModel : jsonModels) {
 		Object object;
 		object.mass = jsonModel["mass"].GetFloat();
 		const auto& collider = jsonModel["collision_shape"];
@@ -65,14 +129,6 @@ void GameState::loadFromFile(Renderer& renderer, std::string fileName)
 		}
 		objects.push_back(object);
 	}
-	std::vector<BakedModel> bakedModels;
-	bakedModels.resize(models.size());
-
-	renderer.bakeModels(models, bakedModels);
-	for (int i = 0; i < models.size(); i++) {
-		objects[i].model = bakedModels[i];
-	}
-
 	for (const auto& instance : doc["scene"]["instances"].GetArray()) {
 		Object& object = objects[instance["model"].GetInt()];
 		const auto& jsonPos = instance["pos"].GetArray();
@@ -103,48 +159,146 @@ void GameState::loadFromFile(Renderer& renderer, std::string fileName)
 		state.inertia = localInertia;
 		state.motion = motionState;
 		state.rigidBody = body;
+		state.publishedTransform = globalTransform;
 
 		object.instances.push_back(state);
 	}
 
 	const auto& jsonCamPos = doc["scene"]["camera"]["pos"].GetArray();
 	cameraPos = { jsonCamPos[0].GetFloat(), jsonCamPos[1].GetFloat(), jsonCamPos[2].GetFloat() };
+	publishedCamera = getCamera();
+
+	auto load = std::make_shared<SceneLoad>();
+	load->_modelCount = objects.size();
+	load->_decode = jobs.parallelFor(modelFiles.size(), 1, [load, modelFiles, modelObjects, &renderer](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			try {
+				Model model = Model::loadFromFile("models/" + modelFiles[i]);
+				renderer.queueModelUpload(std::move(model), [load, users = modelObjects[i]](const BakedModel& baked) {
+					std::lock_guard<std::mutex> lock(load->_mutex);
+					for (size_t object : users) {
+						load->_loaded.push_back({ object, baked });
+					}
+				}, [load](std::exception_ptr error) {
+					load->setError(error);
+				});
+			}
+			catch (...) {
+				load->setError(std::current_exception());
+			}
+		}
+	});
+	return load;
+}
+
+void GameState::loadFromFile(Renderer& renderer, JobSystem& jobs, std::string fileName)
+{
+	PROFILE_ZONE("GameState::loadFromFile");
+	std::shared_ptr<SceneLoad> load = loadFromFileAsync(renderer, jobs, fileName);
+	load->waitDecoded(jobs);
+	renderer.flushUploads();
+	load->apply(*this);
+}
+
+size_t SceneLoad::getModelCount() const
+{
+	return _modelCount;
+}
+
+size_t SceneLoad::getAppliedCount() const
+{
+	return _appliedCount;
+}
+
+bool SceneLoad::isFinished() const
+{
+	return _appliedCount == _modelCount;
+}
+
+void SceneLoad::setError(std::exception_ptr error)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_error) {
+		_error = error;
+	}
+}
+
+bool SceneLoad::apply(GameState& gameState)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_error) {
+		std::rethrow_exception(_error);
+	}
+	for (const LoadedModel& loaded : _loaded) {
+		gameState.objects[loaded.object].model = loaded.model;
+	}
+	_appliedCount += _loaded.size();
+	_loaded.clear();
+	return isFinished();
+}
+
+void SceneLoad::waitDecoded(JobSystem& jobs)
+{
+	jobs.wait(_decode);
+}
+
+size_t GraphicsObjectState::getInstanceCount() const
+{
+	return current.size();
+}
+
+void GraphicsObjectState::resize(size_t count)
+{
+	previous.resize(count);
+	current.resize(count);
+}
+
+void GraphicsObjectState::setInstance(size_t i, glm::vec3 previousPosition, glm::quat previousRotation, glm::vec3 position, glm::quat rotation)
+{
+	previous.set(i, previousPosition.x, previousPosition.y, previousPosition.z, previousRotation.x, previousRotation.y, previousRotation.z, previousRotation.w);
+	current.set(i, position.x, position.y, position.z, rotation.x, rotation.y, rotation.z, rotation.w);
 }
 
 void GameState::initGraphicsGameState(GraphicsGameState& gameState)
 {
 	gameState.objects.resize(objects.size());
 	for (int i = 0; i < objects.size(); i++) {
-		gameState.objects[i].instances.resize(objects[i].instances.size());
+		gameState.objects[i].resize(objects[i].instances.size());
 	}
 }
 
-void GameState::updateGraphicsGameState(GraphicsGameState& gameState)
+static glm::vec3 toGlm(const btVector3& v)
 {
-	glm::mat4 coordTransform = {
-		{1,  0,  0, 0},
-		{0,  0, -1, 0},
-		{0, -1,  0, 0},
-		{0,  0,  0, 1}
-	};
-	glm::mat4 sceneMatrix = glm::perspective(glm::radians(90.0f), 4.0f / 3.0f, 0.1f, 100.0f) * coordTransform * glm::inverse(getCameraMatrix());
-	gameState.sceneMatrix = sceneMatrix;
+	return { v.x(), v.y(), v.z() };
+}
+
+static glm::quat toGlm(const btQuaternion& q)
+{
+	return { q.w(), q.x(), q.y(), q.z() };
+}
+
+void GameState::updateGraphicsGameState(GraphicsGameState& gameState, float interval)
+{
+	PROFILE_ZONE("GameState::updateGraphicsGameState");
+	gameState.previousCamera = publishedCamera;
+	gameState.camera = getCamera();
+	publishedCamera = gameState.camera;
 	for (int i = 0; i < gameState.objects.size(); i++) {
 		gameState.objects[i].model = objects[i].model;
-		for (int k = 0; k < gameState.objects[i].instances.size(); k++) {
-			btVector3 vel = objects[i].instances[k].rigidBody->getLinearVelocity();
-			btVector3 rot = objects[i].instances[k].rigidBody->getAngularVelocity();
-			gameState.objects[i].instances[k].velocity = { vel.x(), vel.y(), vel.z() };
-			gameState.objects[i].instances[k].rotVelocity = { rot.x(), rot.y(), rot.z() };
+		for (int k = 0; k < gameState.objects[i].getInstanceCount(); k++) {
+			DynamicObjectState& object = objects[i].instances[k];
 
 			btTransform globalTransform;
-			objects[i].instances[k].motion->getWorldTransform(globalTransform);
-			glm::mat4 trans;
-			globalTransform.getOpenGLMatrix((btScalar*)&trans);
+			object.motion->getWorldTransform(globalTransform);
+
+			gameState.objects[i].setInstance(k,
+				toGlm(object.publishedTransform.getOrigin()), toGlm(object.publishedTransform.getRotation()),
+				toGlm(globalTransform.getOrigin()), toGlm(globalTransform.getRotation()));
 
-			gameState.objects[i].instances[k].globalTransform = trans;
+			object.publishedTransform = globalTransform;
 		}
 	}
+	gameState.interval = interval;
 	gameState.timeStamp = std::chrono::high_resolution_clock::now();
 }
 
@@ -165,5 +319,6 @@ void Physics::addObject(DynamicObjectState& state)
 
 void Physics::stepPhysics(float dt)
 {
-	_dynamicsWorld->stepSimulation(dt, 50);
+	PROFILE_ZONE("Physics::stepPhysics");
+	_dynamicsWorld->stepSimulation(dt, 1, dt);
 }
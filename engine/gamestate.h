@@ -1,5 +1,7 @@
 #pragma once
 
+#include "instancekernel.h"
+#include "jobsystem.h"
 #include "model.h"
 
 #include <bullet/btBulletDynamicsCommon.h>
@@ -8,17 +10,19 @@
 #include <glm/gtc/quaternion.hpp>
 
 #include <chrono>
+#include <exception>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 
 class Renderer;
-class VulkanContext;
 
 struct DynamicObjectState {
 	btDefaultMotionState* motion;
 	btRigidBody* rigidBody;
 	btVector3 inertia;
+	btTransform publishedTransform;
 };
 
 struct Object {
@@ -28,23 +32,73 @@ struct Object {
 	std::vector<DynamicObjectState> instances;
 };
 
-struct DynamicGraphicsInstanceState {
-	glm::mat4 globalTransform;
-	glm::vec3 velocity;
-	glm::vec3 rotVelocity;
+struct CameraState {
+	glm::vec3 pos;
+	float x;
+	float y;
 };
 
 struct GraphicsObjectState {
 	BakedModel model;
-	std::vector<DynamicGraphicsInstanceState> instances;
+	InstanceTransforms previous;
+	InstanceTransforms current;
+
+	size_t getInstanceCount() const;
+	void resize(size_t count);
+	void setInstance(size_t i, glm::vec3 previousPosition, glm::quat previousRotation, glm::vec3 position, glm::quat rotation);
 };
 
 struct GraphicsGameState {
 	std::vector<GraphicsObjectState> objects;
-	glm::mat4 sceneMatrix;
+	CameraState previousCamera;
+	CameraState camera;
+	float interval;
 	std::chrono::high_resolution_clock::time_point timeStamp;
+
+	float getInterpolation(std::chrono::high_resolution_clock::time_point time) const;
 };
 
+glm::mat4 getCameraMatrix(const CameraState& camera);
+// aspect is the width over the height of the output image.
+glm::mat4 getSceneMatrix(const CameraState& camera, float aspect);
+CameraState interpolate(const CameraState& a, const CameraState& b, float alpha);
+
+
+struct GameState;
+
+// Progress of a scene started with GameState::loadFromFileAsync. Models decode in
+// parallel on the job system and are uploaded by the renderer between frames; each
+// one becomes drawable as soon as its upload has been submitted.
+class SceneLoad {
+	struct LoadedModel {
+		size_t object;
+		BakedModel model;
+	};
+
+	std::mutex _mutex;
+	std::vector<LoadedModel> _loaded;
+	std::exception_ptr _error;
+	size_t _modelCount = 0;
+	size_t _appliedCount = 0;
+	TaskHandle _decode;
+
+	// Keeps the first error.
+	void setError(std::exception_ptr error);
+
+	friend struct GameState;
+public:
+	size_t getModelCount() const;
+	size_t getAppliedCount() const;
+	bool isFinished() const;
+
+	// Moves uploaded models into the game state and rethrows the first load error.
+	// Call from the thread that owns the game state. Returns true once every model
+	// has been applied.
+	bool apply(GameState& gameState);
+	// Blocks until every model has decoded and been queued for upload, so nothing
+	// touches the renderer after this returns.
+	void waitDecoded(JobSystem& jobs);
+};
 
 struct GameState
 {
@@ -52,13 +106,19 @@ struct GameState
 	float cameraX = 0;
 	float cameraY = 0;
 	glm::vec3 cameraPos{ 0.0f, -3.0f, 4.0f };
+	CameraState publishedCamera;
 
+	CameraState getCamera() const;
 	glm::mat4 getCameraMatrix() const;
 
-	void destroy(const VulkanContext& vkCtx);
-	void loadFromFile(Renderer& renderer, std::string fileName);
+	void destroy(Renderer& renderer);
+	// Creates the objects, bodies and camera from the scene file right away and
+	// streams the models in behind them. Objects are skipped by the renderer until
+	// SceneLoad::apply has given them their model.
+	std::shared_ptr<SceneLoad> loadFromFileAsync(Renderer& renderer, JobSystem& jobs, const std::string& fileName);
+	void loadFromFile(Renderer& renderer, JobSystem& jobs, std::string fileName);
 	void initGraphicsGameState(GraphicsGameState& gameState);
-	void updateGraphicsGameState(GraphicsGameState& gameState);
+	void updateGraphicsGameState(GraphicsGameState& gameState, float interval = 0.0f);
 };
 
 class Physics {
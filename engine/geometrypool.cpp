@@ -0,0 +1,161 @@
+#include "geometrypool.h"
+
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+RangeAllocator::RangeAllocator(uint32_t capacity) : _capacity(capacity)
+{
+	if (capacity > 0) {
+		_free[0] = capacity;
+	}
+}
+
+std::optional<uint32_t> RangeAllocator::allocate(uint32_t count)
+{
+	if (count == 0) {
+		return 0;
+	}
+	for (auto it = _free.begin(); it != _free.end(); ++it) {
+		if (it->second < count) {
+			continue;
+		}
+		uint32_t offset = it->first;
+		uint32_t remaining = it->second - count;
+		_free.erase(it);
+		if (remaining > 0) {
+			_free[offset + count] = remaining;
+		}
+		_used += count;
+		return offset;
+	}
+	return std::nullopt;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	_used -= count;
+	auto next = _free.lower_bound(offset);
+	if (next != _free.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			count += previous->second;
+			_free.erase(previous);
+		}
+	}
+	if (next != _free.end() && offset + count == next->first) {
+		count += next->second;
+		_free.erase(next);
+	}
+	_free[offset] = count;
+}
+
+uint32_t RangeAllocator::getCapacity() const
+{
+	return _capacity;
+}
+
+uint32_t RangeAllocator::getUsed() const
+{
+	return _used;
+}
+
+size_t RangeAllocator::getFreeRangeCount() const
+{
+	return _free.size();
+}
+
+static std::vector<uint32_t> getPoolQueueFamilies(const VulkanContext& vkCtx)
+{
+	uint32_t transfer = vkCtx.getQueueFamilies().transferInd.value();
+	uint32_t graphics = vkCtx.getQueueFamilies().graphicsInd.value();
+	if (transfer == graphics) {
+		return {};
+	}
+	return { transfer, graphics };
+}
+
+GeometryPool::GeometryPool(const VulkanContext& vkCtx, VertexFormat vertexFormat, uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t wideIndexCapacity) : _vkCtx(vkCtx),
+_vertexFormat(vertexFormat),
+_vertices(vkCtx, vertexCapacity * ::getVertexSize(vertexFormat), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY, getPoolQueueFamilies(vkCtx)),
+_indices(vkCtx, indexCapacity, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY, getPoolQueueFamilies(vkCtx)),
+_wideIndices(vkCtx, wideIndexCapacity, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY, getPoolQueueFamilies(vkCtx)),
+_vertexRanges(vertexCapacity),
+_indexRanges(indexCapacity),
+_wideIndexRanges(wideIndexCapacity)
+{
+}
+
+GeometryPool::~GeometryPool()
+{
+	_vertices.destroy(_vkCtx);
+	_indices.destroy(_vkCtx);
+	_wideIndices.destroy(_vkCtx);
+}
+
+RangeAllocator& GeometryPool::getIndexRanges(vk::IndexType indexType)
+{
+	return indexType == vk::IndexType::eUint32 ? _wideIndexRanges : _indexRanges;
+}
+
+GeometryAllocation GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount, vk::IndexType indexType)
+{
+	std::optional<uint32_t> vertexOffset = _vertexRanges.allocate(vertexCount);
+	if (!vertexOffset) {
+		throw std::runtime_error("geometry pool is out of space for " + std::to_string(vertexCount) + " vertices");
+	}
+	std::optional<uint32_t> firstIndex = getIndexRanges(indexType).allocate(indexCount);
+	if (!firstIndex) {
+		_vertexRanges.free(*vertexOffset, vertexCount);
+		throw std::runtime_error("geometry pool is out of space for " + std::to_string(indexCount) + " indices");
+	}
+	return { *vertexOffset, vertexCount, *firstIndex, indexCount, indexType };
+}
+
+void GeometryPool::free(const GeometryAllocation& allocation)
+{
+	_vertexRanges.free(allocation.vertexOffset, allocation.vertexCount);
+	getIndexRanges(allocation.indexType).free(allocation.firstIndex, allocation.indexCount);
+}
+
+VertexFormat GeometryPool::getVertexFormat() const
+{
+	return _vertexFormat;
+}
+
+size_t GeometryPool::getVertexSize() const
+{
+	return ::getVertexSize(_vertexFormat);
+}
+
+vk::Buffer GeometryPool::getVertexBuffer() const
+{
+	return _vertices.data;
+}
+
+vk::Buffer GeometryPool::getIndexBuffer(vk::IndexType indexType) const
+{
+	return indexType == vk::IndexType::eUint32 ? _wideIndices.data : _indices.data;
+}
+
+void GeometryPool::bind(vk::CommandBuffer commandBuffer) const
+{
+	vk::DeviceSize offset{};
+	commandBuffer.bindVertexBuffers(0, 1, &_vertices.data, &offset);
+	bindIndices(commandBuffer, vk::IndexType::eUint16);
+}
+
+void GeometryPool::bindIndices(vk::CommandBuffer commandBuffer, vk::IndexType indexType) const
+{
+	commandBuffer.bindIndexBuffer(getIndexBuffer(indexType), 0, indexType);
+}
+
+const RangeAllocator& GeometryPool::getVertexRanges() const
+{
+	return _vertexRanges;
+}
+
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "vertexformat.h"
+#include "vulkancontext.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+
+constexpr uint32_t defaultPoolVertices = 1 << 20;
+constexpr uint32_t defaultPoolIndices = 1 << 22;
+constexpr uint32_t defaultPoolWideIndices = 1 << 20;
+
+// First-fit allocator over element ranges [0, capacity). Freed ranges are merged
+// with their neighbours so the free list stays short.
+class RangeAllocator
+{
+	// Offset of each free range mapped to its length.
+	std::map<uint32_t, uint32_t> _free;
+	uint32_t _capacity;
+	uint32_t _used = 0;
+public:
+	RangeAllocator(uint32_t capacity);
+
+	std::optional<uint32_t> allocate(uint32_t count);
+	void free(uint32_t offset, uint32_t count);
+
+	uint32_t getCapacity() const;
+	uint32_t getUsed() const;
+	size_t getFreeRangeCount() const;
+};
+
+struct GeometryAllocation {
+	uint32_t vertexOffset = 0;
+	uint32_t vertexCount = 0;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	// firstIndex counts in the index buffer of this type.
+	vk::IndexType indexType = vk::IndexType::eUint16;
+};
+
+// One vertex buffer and one index buffer per index width shared by every mesh, so
+// draws only rebind when the index width changes and address their mesh with
+// vertexOffset and firstIndex. Every vertex in the pool uses the same format. The
+// buffers are shared concurrently between the transfer and graphics families, so
+// uploads into one range never need an ownership transfer of the whole pool.
+class GeometryPool
+{
+	const VulkanContext& _vkCtx;
+	VertexFormat _vertexFormat;
+	Buffer<uint8_t> _vertices;
+	Buffer<uint16_t> _indices;
+	Buffer<uint32_t> _wideIndices;
+	RangeAllocator _vertexRanges;
+	RangeAllocator _indexRanges;
+	RangeAllocator _wideIndexRanges;
+
+	RangeAllocator& getIndexRanges(vk::IndexType indexType);
+public:
+	GeometryPool(const VulkanContext& vkCtx, VertexFormat vertexFormat = VertexFormat::Float, uint32_t vertexCapacity = defaultPoolVertices, uint32_t indexCapacity = defaultPoolIndices, uint32_t wideIndexCapacity = defaultPoolWideIndices);
+	GeometryPool(const GeometryPool&) = delete;
+	~GeometryPool();
+
+	// Throws if either buffer has no free range large enough.
+	GeometryAllocation allocate(uint32_t vertexCount, uint32_t indexCount, vk::IndexType indexType);
+	// The GPU must be done with the range, which is reused right away.
+	void free(const GeometryAllocation& allocation);
+
+	VertexFormat getVertexFormat() const;
+	size_t getVertexSize() const;
+	vk::Buffer getVertexBuffer() const;
+	vk::Buffer getIndexBuffer(vk::IndexType indexType) const;
+	// Binds the vertex buffer and the 16-bit index buffer.
+	void bind(vk::CommandBuffer commandBuffer) const;
+	void bindIndices(vk::CommandBuffer commandBuffer, vk::IndexType indexType) const;
+	const RangeAllocator& getVertexRanges() const;
+};
@@ -0,0 +1,452 @@
+#include "gpuculler.h"
+
+#include "cpuprofiler.h"
+#include "gamestate.h"
+#include "shader.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static constexpr uint32_t cullGroupSize = 64;
+static constexpr size_t cullBatchSize = 4096;
+static constexpr size_t streamCount = 14;
+static constexpr uint32_t bindingCount = 9;
+static constexpr uint32_t cullPass = 0;
+static constexpr uint32_t placePass = 1;
+// Distance, in world units, by which the CPU reference may disagree with the GPU
+// about an instance grazing a frustum plane.
+static constexpr float verifyTolerance = 1e-2f;
+
+GpuCuller::GpuCuller(const VulkanContext& vkCtx, JobSystem& jobs, PipelineCache& cache, vk::DescriptorSetLayout modelLayout, size_t frameCount, bool verify) :
+	_vkCtx(vkCtx),
+	_jobs(jobs),
+	_verify(verify)
+{
+	QueueFamilies families = vkCtx.getQueueFamilies();
+	_queueFamilies = { families.computeInd.value() };
+	if (families.graphicsInd.value() != families.computeInd.value()) {
+		_queueFamilies.push_back(families.graphicsInd.value());
+	}
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	for (uint32_t binding = 0; binding < bindingCount; binding++) {
+		bindings.push_back(vk::DescriptorSetLayoutBinding()
+			.setBinding(binding)
+			.setDescriptorCount(1)
+			.setDescriptorType(binding == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute));
+	}
+	_cullLayout = _vkCtx.getDevice().createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo()
+		.setBindingCount((uint32_t)bindings.size())
+		.setPBindings(bindings.data()));
+
+	vk::DescriptorPoolSize descriptorPoolSize[] = {
+		vk::DescriptorPoolSize()
+			.setDescriptorCount((uint32_t)frameCount)
+			.setType(vk::DescriptorType::eUniformBuffer),
+		vk::DescriptorPoolSize()
+			.setDescriptorCount(bindingCount * (uint32_t)frameCount)
+			.setType(vk::DescriptorType::eStorageBuffer)
+	};
+	_descriptorPool = _vkCtx.getDevice().createDescriptorPool(vk::DescriptorPoolCreateInfo()
+		.setMaxSets(2 * (uint32_t)frameCount)
+		.setPPoolSizes(descriptorPoolSize)
+		.setPoolSizeCount(2));
+
+	auto passRange = vk::PushConstantRange()
+		.setStageFlags(vk::ShaderStageFlagBits::eCompute)
+		.setOffset(0)
+		.setSize(sizeof(uint32_t));
+	_pipelineLayout = _vkCtx.getDevice().createPipelineLayout(vk::PipelineLayoutCreateInfo()
+		.setSetLayoutCount(1)
+		.setPSetLayouts(&_cullLayout)
+		.setPushConstantRangeCount(1)
+		.setPPushConstantRanges(&passRange));
+
+	Shader cullShader = Shader::loadShaderFromFile(vkCtx, "shaders/cull.comp.spv");
+	auto stageInfo = vk::PipelineShaderStageCreateInfo()
+		.setModule(cullShader.getShader())
+		.setStage(vk::ShaderStageFlagBits::eCompute)
+		.setPName("main");
+	auto pipelineInfo = vk::ComputePipelineCreateInfo()
+		.setStage(stageInfo)
+		.setLayout(_pipelineLayout);
+	auto creationStart = std::chrono::steady_clock::now();
+	_pipeline = _vkCtx.getDevice().createComputePipeline(cache.getCache(), pipelineInfo);
+	cache.recordCreation(std::chrono::steady_clock::now() - creationStart);
+
+	_commandPool = _vkCtx.getDevice().createCommandPool(vk::CommandPoolCreateInfo()
+		.setQueueFamilyIndex(families.computeInd.value())
+		.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
+	auto commandBuffers = _vkCtx.getDevice().allocateCommandBuffers(vk::CommandBufferAllocateInfo()
+		.setCommandBufferCount((uint32_t)frameCount)
+		.setCommandPool(_commandPool)
+		.setLevel(vk::CommandBufferLevel::ePrimary));
+
+	if (_vkCtx.supportsDeviceExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+		_drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)_vkCtx.getDevice().getProcAddr("vkCmdDrawIndexedIndirectCountKHR");
+	}
+
+	_frames.resize(frameCount);
+	for (size_t i = 0; i < frameCount; i++) {
+		auto& frame = _frames[i];
+		vk::DescriptorSetLayout layouts[] = { _cullLayout, modelLayout };
+		auto descriptors = _vkCtx.getDevice().allocateDescriptorSets(vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(_descriptorPool)
+			.setDescriptorSetCount(2)
+			.setPSetLayouts(layouts));
+		frame.cullDescriptor = descriptors[0];
+		frame.modelDescriptor = descriptors[1];
+		frame.commandBuffer = commandBuffers[i];
+		frame.finished = _vkCtx.getDevice().createSemaphore(vk::SemaphoreCreateInfo());
+		frame.params.allocate(_vkCtx, 1, vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, _queueFamilies);
+		reserve(frame, initialModelCapacity, 1);
+	}
+}
+
+GpuCuller::~GpuCuller()
+{
+	for (auto& frame : _frames) {
+		frame.params.destroy(_vkCtx);
+		frame.streams.destroy(_vkCtx);
+		frame.objects.destroy(_vkCtx);
+		frame.commands.destroy(_vkCtx);
+		frame.counts.destroy(_vkCtx);
+		frame.visible.destroy(_vkCtx);
+		frame.models.destroy(_vkCtx);
+		frame.slots.destroy(_vkCtx);
+		frame.lods.destroy(_vkCtx);
+		_vkCtx.getDevice().destroySemaphore(frame.finished);
+	}
+	_vkCtx.getDevice().destroyCommandPool(_commandPool);
+	_vkCtx.getDevice().destroyPipeline(_pipeline);
+	_vkCtx.getDevice().destroyPipelineLayout(_pipelineLayout);
+	_vkCtx.getDevice().destroyDescriptorPool(_descriptorPool);
+	_vkCtx.getDevice().destroyDescriptorSetLayout(_cullLayout);
+}
+
+void GpuCuller::reserve(GpuCullFrame& frame, size_t instances, size_t objects)
+{
+	if (instances > frame.instanceCapacity) {
+		frame.instanceCapacity = std::max(instances, frame.instanceCapacity * 2);
+		frame.streams.allocate(_vkCtx, streamCount * frame.instanceCapacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, _queueFamilies);
+		frame.visible.allocate(_vkCtx, frame.instanceCapacity, vk::BufferUsageFlagBits::eStorageBuffer, _verify ? VMA_MEMORY_USAGE_GPU_TO_CPU : VMA_MEMORY_USAGE_GPU_ONLY, _queueFamilies);
+		frame.models.allocate(_vkCtx, frame.instanceCapacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, _queueFamilies);
+		frame.slots.allocate(_vkCtx, frame.instanceCapacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, _queueFamilies);
+		// Starts out undefined, which the shader tolerates by clamping the level.
+		frame.lods.allocate(_vkCtx, frame.instanceCapacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, _queueFamilies);
+	}
+	if (objects > frame.objectCapacity) {
+		frame.objectCapacity = std::max(objects, frame.objectCapacity * 2);
+		frame.objects.allocate(_vkCtx, frame.objectCapacity, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, _queueFamilies);
+		frame.commands.allocate(_vkCtx, frame.objectCapacity * maxMeshLods, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, _queueFamilies);
+		frame.counts.allocate(_vkCtx, frame.objectCapacity + 1, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, _queueFamilies);
+	}
+}
+
+void GpuCuller::writeDescriptors(GpuCullFrame& frame)
+{
+	vk::Buffer buffers[] = {
+		frame.params.buffer.data,
+		frame.streams.buffer.data,
+		frame.objects.buffer.data,
+		frame.models.buffer.data,
+		frame.visible.buffer.data,
+		frame.commands.buffer.data,
+		frame.counts.buffer.data,
+		frame.slots.buffer.data,
+		frame.lods.buffer.data
+	};
+
+	vk::DescriptorBufferInfo bufferInfos[bindingCount + 1];
+	vk::WriteDescriptorSet writes[bindingCount + 1];
+	for (uint32_t binding = 0; binding < bindingCount; binding++) {
+		bufferInfos[binding] = vk::DescriptorBufferInfo()
+			.setBuffer(buffers[binding])
+			.setOffset(0)
+			.setRange(VK_WHOLE_SIZE);
+		writes[binding] = vk::WriteDescriptorSet()
+			.setDstSet(frame.cullDescriptor)
+			.setDstBinding(binding)
+			.setDescriptorCount(1)
+			.setDescriptorType(binding == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer)
+			.setPBufferInfo(&bufferInfos[binding]);
+	}
+	bufferInfos[bindingCount] = vk::DescriptorBufferInfo()
+		.setBuffer(frame.models.buffer.data)
+		.setOffset(0)
+		.setRange(VK_WHOLE_SIZE);
+	writes[bindingCount] = vk::WriteDescriptorSet()
+		.setDstSet(frame.modelDescriptor)
+		.setDstBinding(0)
+		.setDescriptorCount(1)
+		.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+		.setPBufferInfo(&bufferInfos[bindingCount]);
+
+	_vkCtx.getDevice().updateDescriptorSets(bindingCount + 1, writes, 0, nullptr);
+}
+
+uint32_t GpuCuller::collect(size_t frameIndex, uint32_t& culled, uint64_t& triangles)
+{
+	auto& frame = _frames[frameIndex];
+	culled = 0;
+	triangles = 0;
+	if (!frame.pending) {
+		return 0;
+	}
+	frame.pending = false;
+
+	vmaInvalidateAllocation(_vkCtx.getAllocator(), frame.counts.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaInvalidateAllocation(_vkCtx.getAllocator(), frame.commands.buffer.allocation, 0, VK_WHOLE_SIZE);
+	uint32_t visible = frame.counts.data[frame.objectCount];
+	culled = frame.instanceCount - visible;
+	for (size_t c = 0; c < frame.objectCount * maxMeshLods; c++) {
+		const auto& command = frame.commands.data[c];
+		triangles += (uint64_t)command.instanceCount * (command.indexCount / 3);
+	}
+
+	if (_verify) {
+		verify(frame);
+	}
+	return visible;
+}
+
+void GpuCuller::verify(GpuCullFrame& frame)
+{
+	vmaInvalidateAllocation(_vkCtx.getAllocator(), frame.visible.buffer.allocation, 0, VK_WHOLE_SIZE);
+
+	uint64_t mismatches = 0;
+	std::vector<uint32_t> gpuVisible;
+	size_t minimalOffset = 0;
+	size_t maximalOffset = 0;
+	for (uint32_t k = 0; k < frame.objectCount; k++) {
+		// Levels are packed back to back from the first level's firstInstance.
+		const auto* commands = frame.commands.data + k * maxMeshLods;
+		uint32_t instanceCount = 0;
+		uint32_t drawCount = 0;
+		bool packed = true;
+		for (uint32_t l = 0; l < frame.lodCounts[k]; l++) {
+			if (commands[l].instanceCount > 0) {
+				packed &= commands[l].firstInstance == commands[0].firstInstance + instanceCount;
+				drawCount = l + 1;
+			}
+			instanceCount += commands[l].instanceCount;
+		}
+		const uint32_t* begin = frame.visible.data + commands[0].firstInstance;
+		gpuVisible.assign(begin, begin + instanceCount);
+		std::sort(gpuVisible.begin(), gpuVisible.end());
+
+		auto minimal = frame.minimalVisible.begin() + minimalOffset;
+		auto maximal = frame.maximalVisible.begin() + maximalOffset;
+		minimalOffset += frame.minimalCounts[k];
+		maximalOffset += frame.maximalCounts[k];
+
+		bool unique = std::adjacent_find(gpuVisible.begin(), gpuVisible.end()) == gpuVisible.end();
+		bool complete = std::includes(gpuVisible.begin(), gpuVisible.end(), minimal, minimal + frame.minimalCounts[k]);
+		bool tight = std::includes(maximal, maximal + frame.maximalCounts[k], gpuVisible.begin(), gpuVisible.end());
+		bool counted = frame.counts.data[k] == drawCount;
+		if (!unique || !complete || !tight || !counted || !packed) {
+			if (_verification.mismatchedObjects + mismatches < 10) {
+				std::cerr << "gpu cull mismatch: object " << k
+					<< ", gpu visible " << instanceCount
+					<< ", cpu visible " << frame.minimalCounts[k] << ".." << frame.maximalCounts[k]
+					<< ", draw count " << frame.counts.data[k] << std::endl;
+			}
+			mismatches++;
+		}
+	}
+
+	_verification.frames++;
+	_verification.mismatchedObjects += mismatches;
+	if (mismatches > 0) {
+		_verification.mismatchedFrames++;
+	}
+}
+
+void GpuCuller::prepare(size_t frameIndex, const GraphicsGameState& gameState, const glm::mat4& sceneMatrix, const float* frustumPlanes, float alpha, uint32_t maxLods)
+{
+	PROFILE_ZONE("GpuCuller::prepare");
+	auto& frame = _frames[frameIndex];
+
+	struct StreamBatch {
+		size_t object;
+		size_t begin;
+		size_t end;
+	};
+	std::vector<StreamBatch> batches;
+	uint32_t instanceCount = 0;
+	for (size_t k = 0; k < gameState.objects.size(); k++) {
+		size_t count = gameState.objects[k].getInstanceCount();
+		for (size_t begin = 0; begin < count; begin += cullBatchSize) {
+			batches.push_back({ k, begin, std::min(count, begin + cullBatchSize) });
+		}
+		instanceCount += (uint32_t)count;
+	}
+	frame.instanceCount = instanceCount;
+	frame.objectCount = (uint32_t)gameState.objects.size();
+	reserve(frame, std::max<size_t>(instanceCount, 1), gameState.objects.size() + 1);
+
+	std::vector<uint32_t> objectOffsets(gameState.objects.size());
+	frame.lodCounts.resize(gameState.objects.size());
+	uint32_t firstInstance = 0;
+	for (size_t k = 0; k < gameState.objects.size(); k++) {
+		const auto& object = gameState.objects[k];
+		const BakedModel& model = object.model;
+		uint32_t lodCount = std::clamp(model.lodCount, 1u, maxLods);
+		objectOffsets[k] = firstInstance;
+		frame.lodCounts[k] = lodCount;
+		frame.objects.data[k] = { firstInstance, model.bounds.getOriginRadius(), model.bounds.radius, lodCount };
+		for (uint32_t l = 0; l < maxMeshLods; l++) {
+			// The placement pass fills in firstInstance for the levels in use.
+			const MeshLod& lod = l < lodCount ? model.lods[l] : MeshLod{ 0, 0 };
+			frame.commands.data[k * maxMeshLods + l] = vk::DrawIndexedIndirectCommand(lod.indexCount, 0, lod.firstIndex, (int32_t)model.geometry.vertexOffset, firstInstance);
+		}
+		frame.counts.data[k] = 0;
+		firstInstance += (uint32_t)object.getInstanceCount();
+	}
+	frame.counts.data[gameState.objects.size()] = 0;
+
+	float* streams = frame.streams.data;
+	size_t capacity = frame.instanceCapacity;
+	_jobs.wait(_jobs.parallelFor(batches.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; b++) {
+			const auto& batch = batches[b];
+			const auto& object = gameState.objects[batch.object];
+			const std::vector<float>* sources[streamCount] = {
+				&object.previous.posX, &object.previous.posY, &object.previous.posZ,
+				&object.previous.rotX, &object.previous.rotY, &object.previous.rotZ, &object.previous.rotW,
+				&object.current.posX, &object.current.posY, &object.current.posZ,
+				&object.current.rotX, &object.current.rotY, &object.current.rotZ, &object.current.rotW
+			};
+			size_t offset = objectOffsets[batch.object] + batch.begin;
+			for (size_t s = 0; s < streamCount; s++) {
+				memcpy(streams + s * capacity + offset, sources[s]->data() + batch.begin, (batch.end - batch.begin) * sizeof(float));
+			}
+		}
+	}));
+
+	CullParams& params = *frame.params.data;
+	params.scene = sceneMatrix;
+	for (int p = 0; p < 6; p++) {
+		params.planes[p] = glm::make_vec4(frustumPlanes + p * 4);
+	}
+	params.alpha = alpha;
+	params.instanceCount = instanceCount;
+	params.objectCount = frame.objectCount;
+	params.streamCapacity = (uint32_t)capacity;
+	params.lodScreenSizes = glm::vec4(lodScreenSizes[0], lodScreenSizes[1], lodScreenSizes[2], 0.0f);
+	params.lodHysteresis = lodHysteresis;
+
+	if (_verify) {
+		frame.minimalVisible.resize(instanceCount);
+		frame.maximalVisible.resize(instanceCount);
+		frame.minimalCounts.resize(frame.objectCount);
+		frame.maximalCounts.resize(frame.objectCount);
+		size_t minimalOffset = 0;
+		size_t maximalOffset = 0;
+		for (size_t k = 0; k < gameState.objects.size(); k++) {
+			const auto& object = gameState.objects[k];
+			float radius = object.model.bounds.getOriginRadius();
+			frame.minimalCounts[k] = (uint32_t)cullInstances(frustumPlanes, radius - verifyTolerance, object.previous, object.current, alpha,
+				0, object.getInstanceCount(), frame.minimalVisible.data() + minimalOffset);
+			frame.maximalCounts[k] = (uint32_t)cullInstances(frustumPlanes, radius + verifyTolerance, object.previous, object.current, alpha,
+				0, object.getInstanceCount(), frame.maximalVisible.data() + maximalOffset);
+			minimalOffset += frame.minimalCounts[k];
+			maximalOffset += frame.maximalCounts[k];
+		}
+	}
+
+	vmaFlushAllocation(_vkCtx.getAllocator(), frame.params.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(_vkCtx.getAllocator(), frame.streams.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(_vkCtx.getAllocator(), frame.objects.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(_vkCtx.getAllocator(), frame.commands.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(_vkCtx.getAllocator(), frame.counts.buffer.allocation, 0, VK_WHOLE_SIZE);
+	writeDescriptors(frame);
+	frame.pending = true;
+}
+
+vk::Semaphore GpuCuller::submit(size_t frameIndex, GpuProfiler& profiler)
+{
+	auto& frame = _frames[frameIndex];
+	vk::CommandBuffer commandBuffer = frame.commandBuffer;
+
+	commandBuffer.reset({});
+	commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	if (frame.instanceCount > 0) {
+		uint32_t groupCount = (frame.instanceCount + cullGroupSize - 1) / cullGroupSize;
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _pipelineLayout, 0, { frame.cullDescriptor }, {});
+		commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(cullPass), &cullPass);
+		GpuRegion cullRegion = profiler.beginRegion(commandBuffer, "cull");
+		commandBuffer.dispatch(groupCount, 1, 1);
+		profiler.endRegion(commandBuffer, cullRegion);
+
+		// Placement reads every level's final count.
+		auto barrier = vk::MemoryBarrier()
+			.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, { barrier }, {}, {});
+		commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(placePass), &placePass);
+		GpuRegion placeRegion = profiler.beginRegion(commandBuffer, "place");
+		commandBuffer.dispatch(groupCount, 1, 1);
+		profiler.endRegion(commandBuffer, placeRegion);
+
+		// collect and verify read the results on the host after the frame's fence, which
+		// alone does not make shader writes visible to the host.
+		auto hostBarrier = vk::MemoryBarrier()
+			.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, { hostBarrier }, {}, {});
+	}
+	commandBuffer.end();
+
+	auto submitInfo = vk::SubmitInfo()
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&commandBuffer)
+		.setSignalSemaphoreCount(1)
+		.setPSignalSemaphores(&frame.finished);
+	_vkCtx.getComputeQueue(0).submit({ submitInfo }, vk::Fence());
+
+	return frame.finished;
+}
+
+void GpuCuller::drawObject(vk::CommandBuffer commandBuffer, size_t frameIndex, size_t object) const
+{
+	const auto& frame = _frames[frameIndex];
+	vk::DeviceSize offset = object * maxMeshLods * sizeof(vk::DrawIndexedIndirectCommand);
+	uint32_t lodCount = frame.lodCounts[object];
+	if (_drawIndexedIndirectCount) {
+		_drawIndexedIndirectCount((VkCommandBuffer)commandBuffer, (VkBuffer)frame.commands.buffer.data, offset,
+			(VkBuffer)frame.counts.buffer.data, object * sizeof(uint32_t), lodCount, sizeof(vk::DrawIndexedIndirectCommand));
+	}
+	else {
+		// One draw per call, as multiDrawIndirect is not enabled.
+		for (uint32_t l = 0; l < lodCount; l++) {
+			commandBuffer.drawIndexedIndirect(frame.commands.buffer.data, offset + l * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
+		}
+	}
+}
+
+vk::DescriptorSet GpuCuller::getModelDescriptor(size_t frame) const
+{
+	return _frames[frame].modelDescriptor;
+}
+
+vk::PipelineStageFlags GpuCuller::getWaitStages() const
+{
+	return vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader;
+}
+
+bool GpuCuller::hasDrawIndirectCount() const
+{
+	return _drawIndexedIndirectCount != nullptr;
+}
+
+const CullVerification& GpuCuller::getVerification() const
+{
+	return _verification;
+}
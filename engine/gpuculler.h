@@ -0,0 +1,155 @@
+#pragma once
+
+#include "defaultuniform.h"
+#include "jobsystem.h"
+#include "gpuprofiler.h"
+#include "pipelinecache.h"
+#include "vulkancontext.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+
+struct GraphicsGameState;
+
+enum class CullMode {
+	Cpu,
+	Gpu,
+	GpuVerify
+};
+
+struct CullParams {
+	glm::mat4 scene;
+	glm::vec4 planes[6];
+	float alpha;
+	uint32_t instanceCount;
+	uint32_t objectCount;
+	uint32_t streamCapacity;
+	// Thresholds of levels 1 to 3, as in lodScreenSizes.
+	glm::vec4 lodScreenSizes;
+	float lodHysteresis;
+};
+
+struct CullObject {
+	uint32_t firstInstance;
+	// Culling radius around the instance origin.
+	float radius;
+	// Bounding sphere radius used for level of detail selection.
+	float lodRadius;
+	uint32_t lodCount;
+};
+
+struct CullVerification {
+	uint64_t frames = 0;
+	uint64_t mismatchedFrames = 0;
+	uint64_t mismatchedObjects = 0;
+};
+
+template<class T>
+struct MappedBuffer {
+	Buffer<T> buffer;
+	T* data = nullptr;
+
+	void allocate(const VulkanContext& vkCtx, size_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memory, const std::vector<uint32_t>& queueFamilies) {
+		destroy(vkCtx);
+		buffer = Buffer<T>(vkCtx, size, usage, memory, queueFamilies);
+		if (memory != VMA_MEMORY_USAGE_GPU_ONLY) {
+			vmaMapMemory(vkCtx.getAllocator(), buffer.allocation, (void**)&data);
+		}
+	}
+
+	void destroy(const VulkanContext& vkCtx) {
+		if (!buffer.data) {
+			return;
+		}
+		if (data) {
+			vmaUnmapMemory(vkCtx.getAllocator(), buffer.allocation);
+			data = nullptr;
+		}
+		buffer.destroy(vkCtx);
+		buffer.data = nullptr;
+	}
+};
+
+struct GpuCullFrame {
+	MappedBuffer<CullParams> params;
+	MappedBuffer<float> streams;
+	MappedBuffer<CullObject> objects;
+	MappedBuffer<vk::DrawIndexedIndirectCommand> commands;
+	MappedBuffer<uint32_t> counts;
+	MappedBuffer<uint32_t> visible;
+	MappedBuffer<ModelUniform> models;
+	// Each visible instance's slot among the instances of its level, written by the
+	// cull pass and read by the placement pass.
+	MappedBuffer<uint32_t> slots;
+	// Level of detail of each instance the last time this frame slot culled it.
+	MappedBuffer<uint32_t> lods;
+	size_t instanceCapacity = 0;
+	size_t objectCapacity = 0;
+	std::vector<uint32_t> lodCounts;
+
+	vk::DescriptorSet cullDescriptor;
+	vk::DescriptorSet modelDescriptor;
+	vk::CommandBuffer commandBuffer;
+	vk::Semaphore finished;
+
+	bool pending = false;
+	uint32_t instanceCount = 0;
+	uint32_t objectCount = 0;
+	// CPU reference for GpuVerify, culled with a slightly smaller and a slightly
+	// larger radius so instances grazing a plane may go either way.
+	std::vector<uint32_t> minimalVisible;
+	std::vector<uint32_t> maximalVisible;
+	std::vector<uint32_t> minimalCounts;
+	std::vector<uint32_t> maximalCounts;
+};
+
+// Culls instances, picks their level of detail and builds their model uniforms and
+// indexed indirect draw commands with a compute shader on the compute queue. Each
+// object gets maxMeshLods consecutive commands, starting at maxMeshLods times its
+// index in the game state, one per level. The instances of an object are packed
+// from its firstInstance, level after level. A first pass culls and counts the
+// instances of each level and a second places them once the counts are known.
+class GpuCuller
+{
+	const VulkanContext& _vkCtx;
+	JobSystem& _jobs;
+	bool _verify;
+	std::vector<uint32_t> _queueFamilies;
+
+	vk::DescriptorSetLayout _cullLayout;
+	vk::DescriptorPool _descriptorPool;
+	vk::PipelineLayout _pipelineLayout;
+	vk::Pipeline _pipeline;
+	vk::CommandPool _commandPool;
+	PFN_vkCmdDrawIndexedIndirectCountKHR _drawIndexedIndirectCount = nullptr;
+
+	std::vector<GpuCullFrame> _frames;
+	CullVerification _verification;
+
+	void reserve(GpuCullFrame& frame, size_t instances, size_t objects);
+	void writeDescriptors(GpuCullFrame& frame);
+	void verify(GpuCullFrame& frame);
+public:
+	GpuCuller(const VulkanContext& vkCtx, JobSystem& jobs, PipelineCache& cache, vk::DescriptorSetLayout modelLayout, size_t frameCount, bool verify);
+	GpuCuller(const GpuCuller&) = delete;
+	~GpuCuller();
+
+	// Reads back the previous results of this frame slot. Its fence must have signaled.
+	// Returns the number of instances that were visible, or 0 if nothing was pending.
+	// Also returns the number of triangles those instances drew.
+	uint32_t collect(size_t frame, uint32_t& culled, uint64_t& triangles);
+	// Objects use at most maxLods levels of detail.
+	void prepare(size_t frame, const GraphicsGameState& gameState, const glm::mat4& sceneMatrix, const float* frustumPlanes, float alpha, uint32_t maxLods);
+	// Submits the cull dispatches, timed as the "cull" and "place" regions of
+	// profiler. The returned semaphore signals once the draw commands and model
+	// uniforms for this frame are ready.
+	vk::Semaphore submit(size_t frame, GpuProfiler& profiler);
+
+	void drawObject(vk::CommandBuffer commandBuffer, size_t frame, size_t object) const;
+	vk::DescriptorSet getModelDescriptor(size_t frame) const;
+	vk::PipelineStageFlags getWaitStages() const;
+	bool hasDrawIndirectCount() const;
+	const CullVerification& getVerification() const;
+};
@@ -0,0 +1,125 @@
+#include "gpuprofiler.h"
+
+#include <algorithm>
+
+static constexpr GpuRegion unrecordedRegion = ~0u;
+
+GpuProfiler::GpuProfiler(const VulkanContext& vkCtx, size_t frameCount, const std::vector<uint32_t>& queueFamilies, uint32_t maxRegions) :
+	_vkCtx(vkCtx),
+	_maxRegions(maxRegions)
+{
+	vk::PhysicalDevice physicalDevice = _vkCtx.getPhysicalDevice();
+	std::vector<vk::QueueFamilyProperties> properties = physicalDevice.getQueueFamilyProperties();
+	uint32_t validBits = 64;
+	for (uint32_t family : queueFamilies) {
+		validBits = std::min(validBits, properties[family].timestampValidBits);
+	}
+	_timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+	if (validBits == 0 || _timestampPeriod <= 0.0f) {
+		return;
+	}
+	_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	_frames.resize(frameCount);
+	for (auto& frame : _frames) {
+		frame.pool = _vkCtx.getDevice().createQueryPool(vk::QueryPoolCreateInfo()
+			.setQueryType(vk::QueryType::eTimestamp)
+			.setQueryCount(2 * _maxRegions));
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for (auto& frame : _frames) {
+		_vkCtx.deviceDestroy(frame.pool);
+	}
+}
+
+bool GpuProfiler::isSupported() const
+{
+	return !_frames.empty();
+}
+
+size_t GpuProfiler::findTiming(const char* name)
+{
+	for (size_t t = 0; t < _timings.size(); t++) {
+		if (_timings[t].name == name) {
+			return t;
+		}
+	}
+	_timings.push_back({ name });
+	return _timings.size() - 1;
+}
+
+bool GpuProfiler::beginFrame(size_t frameIndex)
+{
+	_frame = frameIndex;
+	if (!isSupported()) {
+		return false;
+	}
+
+	auto& frame = _frames[frameIndex];
+	bool collected = false;
+	if (!frame.timings.empty()) {
+		std::vector<uint64_t> timestamps(2 * frame.timings.size());
+		vk::Result result = _vkCtx.getDevice().getQueryPoolResults(frame.pool, 0, (uint32_t)timestamps.size(),
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+		collected = result == vk::Result::eSuccess;
+		for (size_t r = 0; collected && r < frame.timings.size(); r++) {
+			uint64_t ticks = (timestamps[2 * r + 1] - timestamps[2 * r]) & _timestampMask;
+			float ms = (float)(ticks * (double)_timestampPeriod / 1e6);
+
+			GpuRegionTiming& timing = _timings[frame.timings[r]];
+			timing.lastMs = ms;
+			timing.samples[timing.sampleCount % gpuAverageWindow] = ms;
+			timing.sampleCount++;
+			size_t window = std::min(timing.sampleCount, gpuAverageWindow);
+			float sum = 0;
+			for (size_t s = 0; s < window; s++) {
+				sum += timing.samples[s];
+			}
+			timing.averageMs = sum / window;
+		}
+	}
+	frame.timings.clear();
+	return collected;
+}
+
+GpuRegion GpuProfiler::beginRegion(vk::CommandBuffer commandBuffer, const char* name)
+{
+	if (!isSupported()) {
+		return unrecordedRegion;
+	}
+	auto& frame = _frames[_frame];
+	if (frame.timings.size() >= _maxRegions) {
+		return unrecordedRegion;
+	}
+	GpuRegion region = (GpuRegion)frame.timings.size();
+	frame.timings.push_back(findTiming(name));
+	commandBuffer.resetQueryPool(frame.pool, 2 * region, 2);
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.pool, 2 * region);
+	return region;
+}
+
+void GpuProfiler::endRegion(vk::CommandBuffer commandBuffer, GpuRegion region)
+{
+	if (region == unrecordedRegion) {
+		return;
+	}
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, _frames[_frame].pool, 2 * region + 1);
+}
+
+const std::vector<GpuRegionTiming>& GpuProfiler::getTimings() const
+{
+	return _timings;
+}
+
+const GpuRegionTiming* GpuProfiler::getTiming(const char* name) const
+{
+	for (const auto& timing : _timings) {
+		if (timing.name == name && timing.sampleCount > 0) {
+			return &timing;
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "vulkancontext.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+
+constexpr uint32_t defaultMaxGpuRegions = 16;
+// Number of recent samples in each region's rolling average.
+constexpr size_t gpuAverageWindow = 64;
+
+// Identifies a region recorded in the current frame.
+using GpuRegion = uint32_t;
+
+struct GpuRegionTiming {
+	std::string name;
+	float lastMs = 0;
+	float averageMs = 0;
+	std::array<float, gpuAverageWindow> samples{};
+	size_t sampleCount = 0;
+};
+
+// Measures GPU time of named command buffer regions with timestamp query pairs, in
+// one query pool per frame in flight. A frame's results are collected when its slot
+// comes around again, after the caller has waited for it, so reading them never
+// stalls; results that are still unavailable are dropped. Regions can be recorded on
+// any queue family given to the constructor and may nest, but must begin and end
+// outside render passes, as each begin resets its own queries.
+class GpuProfiler
+{
+	struct FrameQueries {
+		vk::QueryPool pool;
+		std::vector<size_t> timings;
+	};
+
+	const VulkanContext& _vkCtx;
+	const uint32_t _maxRegions;
+	float _timestampPeriod = 0;
+	uint64_t _timestampMask = 0;
+	std::vector<FrameQueries> _frames;
+	size_t _frame = 0;
+	// In order of first appearance.
+	std::vector<GpuRegionTiming> _timings;
+
+	size_t findTiming(const char* name);
+public:
+	GpuProfiler(const VulkanContext& vkCtx, size_t frameCount, const std::vector<uint32_t>& queueFamilies, uint32_t maxRegions = defaultMaxGpuRegions);
+	GpuProfiler(const GpuProfiler&) = delete;
+	~GpuProfiler();
+
+	// False when a queue family has no timestamps, in which case regions are not
+	// recorded.
+	bool isSupported() const;
+
+	// Collects the regions frameIndex recorded last time, whose command buffers must
+	// have finished, then starts recording its regions anew. Returns whether new
+	// results were collected.
+	bool beginFrame(size_t frameIndex);
+	// Regions past maxRegions in a frame are ignored.
+	GpuRegion beginRegion(vk::CommandBuffer commandBuffer, const char* name);
+	void endRegion(vk::CommandBuffer commandBuffer, GpuRegion region);
+
+	const std::vector<GpuRegionTiming>& getTimings() const;
+	// nullptr until the region has been collected once.
+	const GpuRegionTiming* getTiming(const char* name) const;
+};
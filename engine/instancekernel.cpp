@@ -0,0 +1,412 @@
+#include "instancekernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define INSTANCE_KERNEL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INSTANCE_KERNEL_SSE
+#endif
+
+constexpr size_t floatsPerInstance = 32;
+
+size_t InstanceTransforms::size() const
+{
+	return posX.size();
+}
+
+void InstanceTransforms::resize(size_t count)
+{
+	for (auto* stream : { &posX, &posY, &posZ, &rotX, &rotY, &rotZ, &rotW }) {
+		stream->resize(count);
+	}
+}
+
+void InstanceTransforms::set(size_t i, float x, float y, float z, float qx, float qy, float qz, float qw)
+{
+	posX[i] = x;
+	posY[i] = y;
+	posZ[i] = z;
+	rotX[i] = qx;
+	rotY[i] = qy;
+	rotZ[i] = qz;
+	rotW[i] = qw;
+}
+
+void extractFrustumPlanes(const float* m, float* planes)
+{
+	// Rows of the column-major clip matrix, combined per Gribb/Hartmann. The near
+	// plane uses the -w..w convention, which is conservative for 0..w depth.
+	const float signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+	for (int p = 0; p < 6; p++) {
+		int row = p / 2;
+		float* plane = planes + p * 4;
+		for (int c = 0; c < 4; c++) {
+			plane[c] = m[c * 4 + 3] + signs[p] * m[c * 4 + row];
+		}
+		// An infinite far plane degenerates to (0, 0, 0, d > 0), which accepts everything.
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f) {
+			for (int c = 0; c < 4; c++) {
+				plane[c] /= length;
+			}
+		}
+	}
+}
+
+static size_t cullInstancesScalar(const float* planes, float radius, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, size_t begin, size_t end, uint32_t* visible)
+{
+	size_t count = 0;
+	for (size_t i = begin; i < end; i++) {
+		float px = previous.posX[i] + (current.posX[i] - previous.posX[i]) * alpha;
+		float py = previous.posY[i] + (current.posY[i] - previous.posY[i]) * alpha;
+		float pz = previous.posZ[i] + (current.posZ[i] - previous.posZ[i]) * alpha;
+		bool inside = true;
+		for (int p = 0; p < 6; p++) {
+			const float* plane = planes + p * 4;
+			inside &= plane[0] * px + plane[1] * py + plane[2] * pz + plane[3] >= -radius;
+		}
+		visible[count] = (uint32_t)i;
+		count += inside;
+	}
+	return count;
+}
+
+static void writeModelUniformsScalar(const float* s, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, const uint32_t* indices, size_t count, float* out)
+{
+	for (size_t n = 0; n < count; n++) {
+		size_t i = indices[n];
+		float px = previous.posX[i] + (current.posX[i] - previous.posX[i]) * alpha;
+		float py = previous.posY[i] + (current.posY[i] - previous.posY[i]) * alpha;
+		float pz = previous.posZ[i] + (current.posZ[i] - previous.posZ[i]) * alpha;
+
+		float dot = previous.rotX[i] * current.rotX[i] + previous.rotY[i] * current.rotY[i] + previous.rotZ[i] * current.rotZ[i] + previous.rotW[i] * current.rotW[i];
+		float a = 1.0f - alpha;
+		float b = dot < 0.0f ? -alpha : alpha;
+		float qx = previous.rotX[i] * a + current.rotX[i] * b;
+		float qy = previous.rotY[i] * a + current.rotY[i] * b;
+		float qz = previous.rotZ[i] * a + current.rotZ[i] * b;
+		float qw = previous.rotW[i] * a + current.rotW[i] * b;
+		float scale = 2.0f / (qx * qx + qy * qy + qz * qz + qw * qw);
+
+		float xx = qx * qx * scale, yy = qy * qy * scale, zz = qz * qz * scale;
+		float xy = qx * qy * scale, xz = qx * qz * scale, yz = qy * qz * scale;
+		float wx = qw * qx * scale, wy = qw * qy * scale, wz = qw * qz * scale;
+
+		float model[16] = {
+			1.0f - yy - zz, xy + wz, xz - wy, 0.0f,
+			xy - wz, 1.0f - xx - zz, yz + wx, 0.0f,
+			xz + wy, yz - wx, 1.0f - xx - yy, 0.0f,
+			px, py, pz, 1.0f
+		};
+
+		float* dst = out + n * floatsPerInstance;
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				dst[c * 4 + r] = s[r] * model[c * 4] + s[4 + r] * model[c * 4 + 1] + s[8 + r] * model[c * 4 + 2] + s[12 + r] * model[c * 4 + 3];
+			}
+		}
+		for (int k = 0; k < 16; k++) {
+			dst[16 + k] = model[k];
+		}
+	}
+}
+
+#if defined(INSTANCE_KERNEL_AVX)
+
+using Lane = __m256;
+constexpr size_t laneWidth = 8;
+
+static inline Lane load(const std::vector<float>& v, size_t i) { return _mm256_loadu_ps(v.data() + i); }
+static inline Lane splat(float f) { return _mm256_set1_ps(f); }
+static inline Lane gather(const std::vector<float>& v, const uint32_t* indices)
+{
+#if defined(__AVX2__)
+	return _mm256_i32gather_ps(v.data(), _mm256_loadu_si256((const __m256i*)indices), sizeof(float));
+#else
+	const float* d = v.data();
+	return _mm256_set_ps(d[indices[7]], d[indices[6]], d[indices[5]], d[indices[4]], d[indices[3]], d[indices[2]], d[indices[1]], d[indices[0]]);
+#endif
+}
+static inline Lane add(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+static inline Lane sub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+static inline Lane mul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+static inline Lane div(Lane a, Lane b) { return _mm256_div_ps(a, b); }
+static inline Lane select(Lane mask, Lane a, Lane b) { return _mm256_blendv_ps(b, a, mask); }
+static inline Lane lessThanZero(Lane a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ); }
+static inline Lane greaterEqual(Lane a, Lane b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline Lane both(Lane a, Lane b) { return _mm256_and_ps(a, b); }
+static inline int laneMask(Lane a) { return _mm256_movemask_ps(a); }
+
+// Transposes eight lanes of eight values into eight rows of eight consecutive floats.
+static inline void transpose(const Lane* in, Lane* rows)
+{
+	__m256 t0 = _mm256_unpacklo_ps(in[0], in[1]);
+	__m256 t1 = _mm256_unpackhi_ps(in[0], in[1]);
+	__m256 t2 = _mm256_unpacklo_ps(in[2], in[3]);
+	__m256 t3 = _mm256_unpackhi_ps(in[2], in[3]);
+	__m256 t4 = _mm256_unpacklo_ps(in[4], in[5]);
+	__m256 t5 = _mm256_unpackhi_ps(in[4], in[5]);
+	__m256 t6 = _mm256_unpacklo_ps(in[6], in[7]);
+	__m256 t7 = _mm256_unpackhi_ps(in[6], in[7]);
+	__m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+	rows[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+	rows[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+	rows[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+	rows[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+	rows[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+	rows[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+	rows[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+	rows[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+static inline void storeBatch(const Lane* values, float* dst, bool stream)
+{
+	constexpr size_t groups = floatsPerInstance / laneWidth;
+	Lane rows[groups][laneWidth];
+	for (size_t group = 0; group < groups; group++) {
+		transpose(values + group * laneWidth, rows[group]);
+	}
+	// Finish each instance before starting the next so only a couple of
+	// write-combining lines are open at a time.
+	for (size_t k = 0; k < laneWidth; k++) {
+		for (size_t group = 0; group < groups; group++) {
+			float* row = dst + k * floatsPerInstance + group * laneWidth;
+			if (stream) {
+				_mm256_stream_ps(row, rows[group][k]);
+			}
+			else {
+				_mm256_storeu_ps(row, rows[group][k]);
+			}
+		}
+	}
+}
+
+static inline void fence() { _mm_sfence(); }
+
+#elif defined(INSTANCE_KERNEL_SSE)
+
+using Lane = __m128;
+constexpr size_t laneWidth = 4;
+
+static inline Lane load(const std::vector<float>& v, size_t i) { return _mm_loadu_ps(v.data() + i); }
+static inline Lane splat(float f) { return _mm_set1_ps(f); }
+static inline Lane gather(const std::vector<float>& v, const uint32_t* indices)
+{
+	const float* d = v.data();
+	return _mm_set_ps(d[indices[3]], d[indices[2]], d[indices[1]], d[indices[0]]);
+}
+static inline Lane add(Lane a, Lane b) { return _mm_add_ps(a, b); }
+static inline Lane sub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+static inline Lane mul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+static inline Lane div(Lane a, Lane b) { return _mm_div_ps(a, b); }
+static inline Lane select(Lane mask, Lane a, Lane b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline Lane lessThanZero(Lane a) { return _mm_cmplt_ps(a, _mm_setzero_ps()); }
+static inline Lane greaterEqual(Lane a, Lane b) { return _mm_cmpge_ps(a, b); }
+static inline Lane both(Lane a, Lane b) { return _mm_and_ps(a, b); }
+static inline int laneMask(Lane a) { return _mm_movemask_ps(a); }
+
+static inline void storeBatch(const Lane* values, float* dst, bool stream)
+{
+	constexpr size_t groups = floatsPerInstance / laneWidth;
+	Lane rows[groups][laneWidth];
+	for (size_t group = 0; group < groups; group++) {
+		__m128 r0 = values[group * 4], r1 = values[group * 4 + 1], r2 = values[group * 4 + 2], r3 = values[group * 4 + 3];
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		rows[group][0] = r0;
+		rows[group][1] = r1;
+		rows[group][2] = r2;
+		rows[group][3] = r3;
+	}
+	for (size_t k = 0; k < laneWidth; k++) {
+		for (size_t group = 0; group < groups; group++) {
+			float* row = dst + k * floatsPerInstance + group * laneWidth;
+			if (stream) {
+				_mm_stream_ps(row, rows[group][k]);
+			}
+			else {
+				_mm_storeu_ps(row, rows[group][k]);
+			}
+		}
+	}
+}
+
+static inline void fence() { _mm_sfence(); }
+
+#endif
+
+#if defined(INSTANCE_KERNEL_AVX) || defined(INSTANCE_KERNEL_SSE)
+
+static size_t cullInstancesBatched(const float* planes, float radius, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, size_t begin, size_t end, uint32_t* visible)
+{
+	Lane p[24];
+	for (int k = 0; k < 24; k++) {
+		p[k] = splat(planes[k]);
+	}
+	Lane alphaLane = splat(alpha);
+	Lane negativeRadius = splat(-radius);
+
+	size_t count = 0;
+	size_t i = begin;
+	for (; i + laneWidth <= end; i += laneWidth) {
+		Lane px = add(load(previous.posX, i), mul(sub(load(current.posX, i), load(previous.posX, i)), alphaLane));
+		Lane py = add(load(previous.posY, i), mul(sub(load(current.posY, i), load(previous.posY, i)), alphaLane));
+		Lane pz = add(load(previous.posZ, i), mul(sub(load(current.posZ, i), load(previous.posZ, i)), alphaLane));
+
+		Lane inside = greaterEqual(add(add(mul(p[0], px), mul(p[1], py)), add(mul(p[2], pz), p[3])), negativeRadius);
+		for (int k = 1; k < 6; k++) {
+			const Lane* plane = p + k * 4;
+			inside = both(inside, greaterEqual(add(add(mul(plane[0], px), mul(plane[1], py)), add(mul(plane[2], pz), plane[3])), negativeRadius));
+		}
+
+		int mask = laneMask(inside);
+		for (size_t lane = 0; lane < laneWidth; lane++) {
+			visible[count] = (uint32_t)(i + lane);
+			count += (mask >> lane) & 1;
+		}
+	}
+	return count + cullInstancesScalar(planes, radius, previous, current, alpha, i, end, visible + count);
+}
+
+static void writeModelUniformsBatch(const Lane* s, const InstanceTransforms& previous, const InstanceTransforms& current, Lane alpha, const uint32_t* indices, float* dst, bool stream)
+{
+	Lane one = splat(1.0f);
+	Lane zero = splat(0.0f);
+
+	// Culling keeps indices ascending, so a run that spans exactly one batch is contiguous.
+	bool contiguous = indices[laneWidth - 1] - indices[0] == laneWidth - 1;
+	auto fetch = [&](const std::vector<float>& v) { return contiguous ? load(v, indices[0]) : gather(v, indices); };
+
+	Lane px = add(fetch(previous.posX), mul(sub(fetch(current.posX), fetch(previous.posX)), alpha));
+	Lane py = add(fetch(previous.posY), mul(sub(fetch(current.posY), fetch(previous.posY)), alpha));
+	Lane pz = add(fetch(previous.posZ), mul(sub(fetch(current.posZ), fetch(previous.posZ)), alpha));
+
+	Lane ax = fetch(previous.rotX), ay = fetch(previous.rotY), az = fetch(previous.rotZ), aw = fetch(previous.rotW);
+	Lane bx = fetch(current.rotX), by = fetch(current.rotY), bz = fetch(current.rotZ), bw = fetch(current.rotW);
+	Lane dot = add(add(mul(ax, bx), mul(ay, by)), add(mul(az, bz), mul(aw, bw)));
+	Lane a = sub(one, alpha);
+	Lane b = select(lessThanZero(dot), sub(zero, alpha), alpha);
+	Lane qx = add(mul(ax, a), mul(bx, b));
+	Lane qy = add(mul(ay, a), mul(by, b));
+	Lane qz = add(mul(az, a), mul(bz, b));
+	Lane qw = add(mul(aw, a), mul(bw, b));
+	Lane scale = div(splat(2.0f), add(add(mul(qx, qx), mul(qy, qy)), add(mul(qz, qz), mul(qw, qw))));
+
+	Lane sqx = mul(qx, scale), sqy = mul(qy, scale), sqz = mul(qz, scale);
+	Lane xx = mul(qx, sqx), yy = mul(qy, sqy), zz = mul(qz, sqz);
+	Lane xy = mul(qx, sqy), xz = mul(qx, sqz), yz = mul(qy, sqz);
+	Lane wx = mul(qw, sqx), wy = mul(qw, sqy), wz = mul(qw, sqz);
+
+	Lane values[floatsPerInstance];
+	Lane* model = values + 16;
+	model[0] = sub(sub(one, yy), zz);
+	model[1] = add(xy, wz);
+	model[2] = sub(xz, wy);
+	model[3] = zero;
+	model[4] = sub(xy, wz);
+	model[5] = sub(sub(one, xx), zz);
+	model[6] = add(yz, wx);
+	model[7] = zero;
+	model[8] = add(xz, wy);
+	model[9] = sub(yz, wx);
+	model[10] = sub(sub(one, xx), yy);
+	model[11] = zero;
+	model[12] = px;
+	model[13] = py;
+	model[14] = pz;
+	model[15] = one;
+
+	for (int c = 0; c < 3; c++) {
+		for (int r = 0; r < 4; r++) {
+			values[c * 4 + r] = add(add(mul(s[r], model[c * 4]), mul(s[4 + r], model[c * 4 + 1])), mul(s[8 + r], model[c * 4 + 2]));
+		}
+	}
+	for (int r = 0; r < 4; r++) {
+		values[12 + r] = add(add(mul(s[r], px), mul(s[4 + r], py)), add(mul(s[8 + r], pz), s[12 + r]));
+	}
+
+	storeBatch(values, dst, stream);
+}
+
+size_t cullInstances(const float* planes, float radius, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, size_t begin, size_t end, uint32_t* visible)
+{
+	return cullInstancesBatched(planes, radius, previous, current, alpha, begin, end, visible);
+}
+
+void writeModelUniforms(const float* sceneMatrix, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, const uint32_t* indices, size_t count, float* out)
+{
+	Lane s[16];
+	for (int k = 0; k < 16; k++) {
+		s[k] = splat(sceneMatrix[k]);
+	}
+	Lane alphaLane = splat(alpha);
+	bool stream = ((uintptr_t)out % (laneWidth * sizeof(float))) == 0;
+
+	size_t n = 0;
+	for (; n + laneWidth <= count; n += laneWidth) {
+		writeModelUniformsBatch(s, previous, current, alphaLane, indices + n, out + n * floatsPerInstance, stream);
+	}
+	if (stream) {
+		fence();
+	}
+	writeModelUniformsScalar(sceneMatrix, previous, current, alpha, indices + n, count - n, out + n * floatsPerInstance);
+}
+
+#else
+
+size_t cullInstances(const float* planes, float radius, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, size_t begin, size_t end, uint32_t* visible)
+{
+	return cullInstancesScalar(planes, radius, previous, current, alpha, begin, end, visible);
+}
+
+void writeModelUniforms(const float* sceneMatrix, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, const uint32_t* indices, size_t count, float* out)
+{
+	writeModelUniformsScalar(sceneMatrix, previous, current, alpha, indices, count, out);
+}
+
+#endif
+
+static uint32_t countLodsBelow(float size, const float* thresholds, uint32_t lodCount, float bias)
+{
+	uint32_t lod = 0;
+	while (lod + 1 < lodCount && size < thresholds[lod] * bias) {
+		lod++;
+	}
+	return lod;
+}
+
+void selectLods(const float* sceneMatrix, float radius, const float* thresholds, uint32_t lodCount, float hysteresis, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, const uint32_t* indices, size_t count, uint8_t* lods)
+{
+	const float* s = sceneMatrix;
+	float scale = radius * std::sqrt(s[1] * s[1] + s[5] * s[5] + s[9] * s[9]);
+	for (size_t n = 0; n < count; n++) {
+		size_t i = indices[n];
+		float px = previous.posX[i] + (current.posX[i] - previous.posX[i]) * alpha;
+		float py = previous.posY[i] + (current.posY[i] - previous.posY[i]) * alpha;
+		float pz = previous.posZ[i] + (current.posZ[i] - previous.posZ[i]) * alpha;
+		float depth = s[3] * px + s[7] * py + s[11] * pz + s[15];
+		float size = scale / std::max(depth, 1e-4f);
+
+		uint32_t lod = std::min<uint32_t>(lods[i], lodCount - 1);
+		uint32_t coarse = countLodsBelow(size, thresholds, lodCount, 1.0f - hysteresis);
+		uint32_t fine = countLodsBelow(size, thresholds, lodCount, 1.0f + hysteresis);
+		if (lod < coarse) {
+			lod = coarse;
+		}
+		else if (lod > fine) {
+			lod = fine;
+		}
+		lods[i] = (uint8_t)lod;
+	}
+}
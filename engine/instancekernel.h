@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+struct InstanceTransforms {
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rotX, rotY, rotZ, rotW;
+
+	size_t size() const;
+	void resize(size_t count);
+	void set(size_t i, float x, float y, float z, float qx, float qy, float qz, float qw);
+};
+
+// Fills planes with the six inward-facing, normalized (a, b, c, d) planes of the
+// frustum described by a column-major view-projection matrix.
+void extractFrustumPlanes(const float* matrix, float* planes);
+
+// Writes the indices of instances in [begin, end) whose bounding sphere, centered on
+// the interpolated position, is not entirely outside one of the planes. Indices are
+// written in ascending order and visible must have room for end - begin entries.
+// Returns the number of visible instances.
+size_t cullInstances(const float* planes, float radius, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, size_t begin, size_t end, uint32_t* visible);
+
+// Interpolates the listed instances between previous and current and writes a
+// { scene * model, model } pair of column-major 4x4 matrices per instance to out.
+// Rotations are blended with a normalized lerp. Batches are written with
+// non-temporal stores when out is suitably aligned, so out should be write-combined
+// or otherwise not read back soon.
+void writeModelUniforms(const float* sceneMatrix, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, const uint32_t* indices, size_t count, float* out);
+
+// Chooses a level of detail for each listed instance from the projected radius of
+// its bounding sphere, radius / depth scaled by the projection's vertical focal
+// length, so 1 spans half the viewport height. Level l > 0 applies below
+// thresholds[l - 1], which must be descending. lods holds each instance's level from
+// the previous call and is updated; an instance only moves to a coarser level once
+// its size is a hysteresis fraction below the threshold and back once it is that far
+// above, so instances near a threshold do not flicker between levels.
+void selectLods(const float* sceneMatrix, float radius, const float* thresholds, uint32_t lodCount, float hysteresis, const InstanceTransforms& previous, const InstanceTransforms& current, float alpha, const uint32_t* indices, size_t count, uint8_t* lods);
@@ -0,0 +1,217 @@
+#include "jobsystem.h"
+
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local size_t currentThreadIndex = 0;
+
+JobSystem::JobSystem(size_t workerCount)
+{
+	workerCount = std::max<size_t>(workerCount, 1);
+	for (size_t i = 0; i < workerCount; i++) {
+		_queues.push_back(std::make_unique<WorkQueue>());
+	}
+	for (size_t i = 0; i < workerCount; i++) {
+		_workers.emplace_back([this, i] { workerLoop(i); });
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_running = false;
+	}
+	_wake.notify_all();
+	for (auto& worker : _workers) {
+		worker.join();
+	}
+}
+
+size_t JobSystem::getWorkerCount() const
+{
+	return _workers.size();
+}
+
+size_t JobSystem::getMaxThreadCount() const
+{
+	return _workers.size() + maxExternalThreads;
+}
+
+size_t JobSystem::getThreadIndex()
+{
+	if (currentSystem != this) {
+		size_t external = _externalThreads++;
+		if (external >= maxExternalThreads) {
+			throw std::runtime_error("too many threads using the job system");
+		}
+		currentSystem = this;
+		currentThreadIndex = _workers.size() + external;
+	}
+	return currentThreadIndex;
+}
+
+TaskHandle JobSystem::schedule(std::function<void()> work, const std::vector<TaskHandle>& dependencies)
+{
+	auto task = std::make_shared<Task>();
+	task->work = std::move(work);
+	task->dependencies = dependencies;
+
+	for (const auto& dependency : dependencies) {
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (!dependency->finished) {
+			task->unfinishedDependencies++;
+			dependency->continuations.push_back(task);
+		}
+	}
+
+	if (--task->unfinishedDependencies == 0) {
+		enqueue(task);
+	}
+	return task;
+}
+
+TaskHandle JobSystem::parallelFor(size_t count, size_t grain, std::function<void(size_t, size_t)> work, const std::vector<TaskHandle>& dependencies)
+{
+	grain = std::max<size_t>(grain, 1);
+	auto shared = std::make_shared<std::function<void(size_t, size_t)>>(std::move(work));
+
+	std::vector<TaskHandle> chunks;
+	chunks.reserve((count + grain - 1) / grain);
+	for (size_t begin = 0; begin < count; begin += grain) {
+		size_t end = std::min(count, begin + grain);
+		chunks.push_back(schedule([shared, begin, end] { (*shared)(begin, end); }, dependencies));
+	}
+	if (chunks.empty()) {
+		chunks = dependencies;
+	}
+	return schedule([] {}, chunks);
+}
+
+void JobSystem::wait(const TaskHandle& task)
+{
+	getThreadIndex();
+	while (!task->done.load(std::memory_order_acquire)) {
+		if (!runOne()) {
+			task->done.wait(false, std::memory_order_acquire);
+		}
+	}
+	if (task->error) {
+		std::rethrow_exception(task->error);
+	}
+}
+
+void JobSystem::enqueue(TaskHandle task)
+{
+	WorkQueue& queue = currentSystem == this && currentThreadIndex < _queues.size() ? *_queues[currentThreadIndex] : _injectionQueue;
+	// Counted before it is published, so a thief that takes it straight away never
+	// decrements past zero.
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_queuedTasks++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	_wake.notify_one();
+}
+
+TaskHandle JobSystem::findTask(size_t thread)
+{
+	TaskHandle task;
+	if (thread < _queues.size()) {
+		WorkQueue& own = *_queues[thread];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+		}
+	}
+	if (!task) {
+		std::lock_guard<std::mutex> lock(_injectionQueue.mutex);
+		if (!_injectionQueue.tasks.empty()) {
+			task = std::move(_injectionQueue.tasks.front());
+			_injectionQueue.tasks.pop_front();
+		}
+	}
+	for (size_t i = 1; !task && i <= _queues.size(); i++) {
+		WorkQueue& victim = *_queues[(thread + i) % _queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+		}
+	}
+	if (task) {
+		_queuedTasks--;
+	}
+	return task;
+}
+
+void JobSystem::execute(const TaskHandle& task)
+{
+	for (const auto& dependency : task->dependencies) {
+		if (dependency->error) {
+			task->error = dependency->error;
+			break;
+		}
+	}
+	task->dependencies.clear();
+
+	if (!task->error) {
+		try {
+			task->work();
+		}
+		catch (...) {
+			task->error = std::current_exception();
+		}
+	}
+	task->work = nullptr;
+
+	std::vector<TaskHandle> continuations;
+	{
+		std::lock_guard<std::mutex> lock(task->mutex);
+		task->finished = true;
+		continuations.swap(task->continuations);
+	}
+	task->done.store(true, std::memory_order_release);
+	task->done.notify_all();
+
+	for (auto& continuation : continuations) {
+		if (--continuation->unfinishedDependencies == 0) {
+			enqueue(std::move(continuation));
+		}
+	}
+}
+
+bool JobSystem::runOne()
+{
+	TaskHandle task = findTask(getThreadIndex());
+	if (!task) {
+		return false;
+	}
+	execute(task);
+	return true;
+}
+
+void JobSystem::workerLoop(size_t worker)
+{
+	currentSystem = this;
+	currentThreadIndex = worker;
+	PROFILE_THREAD("worker " + std::to_string(worker));
+	while (true) {
+		if (runOne()) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_wake.wait(lock, [&] { return !_running || _queuedTasks > 0; });
+		if (!_running && _queuedTasks == 0) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+struct Task {
+	std::function<void()> work;
+	std::vector<std::shared_ptr<Task>> dependencies;
+	std::atomic<uint32_t> unfinishedDependencies = 1;
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<Task>> continuations;
+	bool finished = false;
+
+	std::atomic<bool> done = false;
+	std::exception_ptr error;
+};
+
+using TaskHandle = std::shared_ptr<Task>;
+
+struct WorkQueue {
+	std::mutex mutex;
+	std::deque<TaskHandle> tasks;
+};
+
+class JobSystem
+{
+	static constexpr size_t maxExternalThreads = 4;
+
+	std::vector<std::unique_ptr<WorkQueue>> _queues;
+	WorkQueue _injectionQueue;
+	std::vector<std::thread> _workers;
+
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+	std::atomic<size_t> _queuedTasks = 0;
+	std::atomic<size_t> _externalThreads = 0;
+	bool _running = true;
+
+	void workerLoop(size_t worker);
+	void enqueue(TaskHandle task);
+	TaskHandle findTask(size_t thread);
+	void execute(const TaskHandle& task);
+	bool runOne();
+public:
+	JobSystem(size_t workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1);
+	JobSystem(const JobSystem&) = delete;
+	~JobSystem();
+
+	size_t getWorkerCount() const;
+	size_t getMaxThreadCount() const;
+
+	// Stable per-thread index in [0, getMaxThreadCount()). Workers come first, other threads
+	// are assigned the following indices the first time they ask.
+	size_t getThreadIndex();
+
+	TaskHandle schedule(std::function<void()> work, const std::vector<TaskHandle>& dependencies = {});
+	TaskHandle parallelFor(size_t count, size_t grain, std::function<void(size_t, size_t)> work, const std::vector<TaskHandle>& dependencies = {});
+
+	// Runs other tasks until the given one has finished, then rethrows anything it threw.
+	void wait(const TaskHandle& task);
+};
@@ -0,0 +1,98 @@
+#include "latencyhistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+static constexpr uint32_t subBucketBits = 6;
+static constexpr uint64_t subBucketCount = 1 << subBucketBits;
+
+// Values below 2 * subBucketCount get a bucket each. Above that, a value whose top
+// bit is k lands in one of subBucketCount buckets of width 2^(k - subBucketBits).
+static uint32_t getShift(uint64_t value)
+{
+	uint32_t width = (uint32_t)std::bit_width(value);
+	return width > subBucketBits + 1 ? width - subBucketBits - 1 : 0;
+}
+
+static size_t getBucket(uint64_t value)
+{
+	uint32_t shift = getShift(value);
+	return (size_t)(subBucketCount * shift + (value >> shift));
+}
+
+static uint64_t getBucketUpperBound(size_t bucket)
+{
+	if (bucket < 2 * subBucketCount) {
+		return bucket;
+	}
+	uint64_t shift = bucket / subBucketCount - 1;
+	uint64_t lower = (bucket - subBucketCount * shift) << shift;
+	return lower + (1ull << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram(std::chrono::duration<double, std::milli> hitchThreshold) :
+	_hitchMicroseconds((uint64_t)std::chrono::duration<double, std::micro>(hitchThreshold).count()),
+	_counts(getBucket(maxHistogramMicroseconds) + 1)
+{
+}
+
+void LatencyHistogram::record(std::chrono::duration<double, std::micro> duration)
+{
+	uint64_t value = (uint64_t)std::clamp(duration.count(), 0.0, (double)maxHistogramMicroseconds);
+	_counts[getBucket(value)]++;
+	_total++;
+	_max = std::max(_max, value);
+	if (value > _hitchMicroseconds) {
+		_hitches++;
+	}
+}
+
+void LatencyHistogram::reset()
+{
+	std::fill(_counts.begin(), _counts.end(), 0);
+	_total = 0;
+	_max = 0;
+	_hitches = 0;
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+	return _total;
+}
+
+uint64_t LatencyHistogram::getHitches() const
+{
+	return _hitches;
+}
+
+double LatencyHistogram::getPercentile(double percentile) const
+{
+	if (_total == 0) {
+		return 0.0;
+	}
+	uint64_t rank = std::max<uint64_t>((uint64_t)std::ceil(percentile / 100.0 * _total), 1);
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < _counts.size(); bucket++) {
+		seen += _counts[bucket];
+		if (seen >= rank) {
+			return std::min(getBucketUpperBound(bucket), _max) / 1000.0;
+		}
+	}
+	return getMax();
+}
+
+double LatencyHistogram::getMax() const
+{
+	return _max / 1000.0;
+}
+
+void LatencyHistogram::report(std::ostream& out, const std::string& name) const
+{
+	out << name << ": " << _total << " samples"
+		<< ", p50 " << getPercentile(50) << " ms"
+		<< ", p95 " << getPercentile(95) << " ms"
+		<< ", p99 " << getPercentile(99) << " ms"
+		<< ", max " << getMax() << " ms"
+		<< ", hitches " << _hitches << " over " << _hitchMicroseconds / 1000.0 << " ms" << std::endl;
+}
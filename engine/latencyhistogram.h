@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Durations above this are counted as this.
+constexpr uint64_t maxHistogramMicroseconds = 60'000'000;
+// Frames slower than this miss 30 Hz.
+constexpr float defaultHitchMilliseconds = 1000.0f / 30.0f;
+
+// Histogram of durations at microsecond resolution in the style of HdrHistogram:
+// buckets are linear below 128 us and then split each power of two into 64, so
+// every percentile is within about 1.6% of the recorded value however far into the
+// tail it lies, in a few kilobytes. Durations above the hitch threshold are also
+// counted separately. Not thread safe.
+class LatencyHistogram
+{
+	const uint64_t _hitchMicroseconds;
+	std::vector<uint64_t> _counts;
+	uint64_t _total = 0;
+	uint64_t _max = 0;
+	uint64_t _hitches = 0;
+
+public:
+	LatencyHistogram(std::chrono::duration<double, std::milli> hitchThreshold);
+
+	void record(std::chrono::duration<double, std::micro> duration);
+	void reset();
+
+	uint64_t getCount() const;
+	uint64_t getHitches() const;
+	// Upper bound, in milliseconds, of the bucket holding the given percentile.
+	double getPercentile(double percentile) const;
+	double getMax() const;
+
+	// One line: count, p50, p95, p99, max and hitches.
+	void report(std::ostream& out, const std::string& name) const;
+};
@@ -0,0 +1,245 @@
+#include "meshfile.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+	_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		_file = nullptr;
+		throw std::runtime_error("failed to open " + path);
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(_file, &size);
+	_size = (size_t)size.QuadPart;
+	if (_size == 0) {
+		return;
+	}
+
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping) {
+		_data = (const uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!_data) {
+		if (_mapping) {
+			CloseHandle(_mapping);
+		}
+		CloseHandle(_file);
+		throw std::runtime_error("failed to map " + path);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping) {
+		CloseHandle(_mapping);
+	}
+	if (_file) {
+		CloseHandle(_file);
+	}
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+	_fd = open(path.c_str(), O_RDONLY);
+	if (_fd < 0) {
+		throw std::runtime_error("failed to open " + path);
+	}
+
+	struct stat info;
+	fstat(_fd, &info);
+	_size = (size_t)info.st_size;
+	if (_size == 0) {
+		return;
+	}
+
+	void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (data == MAP_FAILED) {
+		close(_fd);
+		throw std::runtime_error("failed to map " + path);
+	}
+	_data = (const uint8_t*)data;
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data) {
+		munmap((void*)_data, _size);
+	}
+	if (_fd >= 0) {
+		close(_fd);
+	}
+}
+
+#endif
+
+const uint8_t* MappedFile::data() const
+{
+	return _data;
+}
+
+size_t MappedFile::size() const
+{
+	return _size;
+}
+
+Bounds Bounds::fromVertices(std::span<const Vertex> vertices)
+{
+	Bounds bounds;
+	if (vertices.empty()) {
+		return bounds;
+	}
+	bounds.min = vertices[0].pos;
+	bounds.max = vertices[0].pos;
+	for (const Vertex& vertex : vertices) {
+		bounds.min = glm::min(bounds.min, vertex.pos);
+		bounds.max = glm::max(bounds.max, vertex.pos);
+	}
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	for (const Vertex& vertex : vertices) {
+		bounds.radius = std::max(bounds.radius, glm::length(vertex.pos - bounds.center));
+	}
+	return bounds;
+}
+
+float Bounds::getOriginRadius() const
+{
+	return glm::length(center) + radius;
+}
+
+IndexData::IndexData(std::span<const uint16_t> indices) : data(indices.data()), count(indices.size()), size(sizeof(uint16_t))
+{
+}
+
+IndexData::IndexData(std::span<const uint32_t> indices) : data(indices.data()), count(indices.size()), size(sizeof(uint32_t))
+{
+}
+
+IndexData::IndexData(const void* data, size_t count, uint32_t size) : data(data), count(count), size(size)
+{
+}
+
+size_t IndexData::size_bytes() const
+{
+	return count * size;
+}
+
+uint32_t IndexData::operator[](size_t i) const
+{
+	if (size == sizeof(uint16_t)) {
+		return ((const uint16_t*)data)[i];
+	}
+	return ((const uint32_t*)data)[i];
+}
+
+static size_t alignMeshOffset(size_t offset)
+{
+	return (offset + meshFileAlignment - 1) / meshFileAlignment * meshFileAlignment;
+}
+
+std::optional<MeshView> readMeshFile(const MappedFile& file)
+{
+	const uint8_t* data = file.data();
+	size_t size = file.size();
+	if (size < sizeof(MeshFileHeader)) {
+		return std::nullopt;
+	}
+
+	MeshFileHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != meshFileMagic || header.version != meshFileVersion
+		|| header.vertexStride != sizeof(Vertex) || (header.indexSize != sizeof(uint16_t) && header.indexSize != sizeof(uint32_t))
+		|| header.vertexOffset % meshFileAlignment != 0 || header.indexOffset % meshFileAlignment != 0
+		|| header.vertexOffset > size || header.vertexCount > (size - header.vertexOffset) / sizeof(Vertex)
+		|| header.indexOffset > size || header.indexCount > (size - header.indexOffset) / header.indexSize
+		|| header.lodCount == 0 || header.lodCount > maxMeshLods) {
+		return std::nullopt;
+	}
+	for (uint32_t l = 0; l < header.lodCount; l++) {
+		const MeshLod& lod = header.lods[l];
+		if (lod.firstIndex > header.indexCount || lod.indexCount > header.indexCount - lod.firstIndex) {
+			return std::nullopt;
+		}
+	}
+
+	MeshView mesh;
+	mesh.vertices = { (const Vertex*)(data + header.vertexOffset), (size_t)header.vertexCount };
+	mesh.indices = IndexData(data + header.indexOffset, (size_t)header.indexCount, header.indexSize);
+	mesh.bounds.min = glm::make_vec3(header.boundsMin);
+	mesh.bounds.max = glm::make_vec3(header.boundsMax);
+	mesh.bounds.center = glm::make_vec3(header.boundsCenter);
+	mesh.bounds.radius = header.boundsRadius;
+	mesh.lods = { ((const MeshFileHeader*)data)->lods, header.lodCount };
+	return mesh;
+}
+
+void writeMeshFile(const std::string& fileName, const MeshView& mesh)
+{
+	MeshFileHeader header{};
+	header.magic = meshFileMagic;
+	header.version = meshFileVersion;
+	header.vertexStride = sizeof(Vertex);
+	header.indexSize = mesh.indices.size;
+	header.vertexCount = mesh.vertices.size();
+	header.vertexOffset = alignMeshOffset(sizeof(MeshFileHeader));
+	header.indexCount = mesh.indices.count;
+	header.indexOffset = alignMeshOffset(header.vertexOffset + mesh.vertices.size_bytes());
+	memcpy(header.boundsMin, &mesh.bounds.min, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &mesh.bounds.max, sizeof(header.boundsMax));
+	memcpy(header.boundsCenter, &mesh.bounds.center, sizeof(header.boundsCenter));
+	header.boundsRadius = mesh.bounds.radius;
+	if (mesh.lods.empty() || mesh.lods.size() > maxMeshLods) {
+		throw std::runtime_error("mesh has " + std::to_string(mesh.lods.size()) + " levels of detail");
+	}
+	header.lodCount = (uint32_t)mesh.lods.size();
+	std::copy(mesh.lods.begin(), mesh.lods.end(), header.lods);
+
+	// Unique per writer, so concurrent writers never interleave within one file.
+	static std::atomic<uint64_t> tempCounter = 0;
+	std::string tempName = fileName + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()))
+		+ "." + std::to_string(tempCounter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open " + tempName);
+		}
+		const char padding[meshFileAlignment] = {};
+		file.write((const char*)&header, sizeof(header));
+		file.write(padding, header.vertexOffset - sizeof(header));
+		file.write((const char*)mesh.vertices.data(), mesh.vertices.size_bytes());
+		file.write(padding, header.indexOffset - header.vertexOffset - mesh.vertices.size_bytes());
+		file.write((const char*)mesh.indices.data, mesh.indices.size_bytes());
+		if (!file) {
+			throw std::runtime_error("failed to write " + tempName);
+		}
+	}
+	std::filesystem::rename(tempName, fileName);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+
+struct Vertex {
+	glm::vec3 pos;
+	glm::vec3 normal;
+};
+
+struct Bounds {
+	glm::vec3 min{};
+	glm::vec3 max{};
+	glm::vec3 center{};
+	float radius = 0;
+
+	static Bounds fromVertices(std::span<const Vertex> vertices);
+	// Radius of a sphere around the model origin that contains the bounding sphere,
+	// so it holds for any instance rotation.
+	float getOriginRadius() const;
+};
+
+
+constexpr uint32_t meshFileMagic = 0x4853454d; // "MESH"
+constexpr uint32_t meshFileVersion = 3;
+constexpr size_t meshFileAlignment = 64;
+constexpr size_t maxMeshLods = 4;
+
+// A level of detail: a range of the mesh's index buffer. Every level indexes the
+// same vertices, and level 0 is the full detail mesh.
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// Cooked mesh layout: this header, then the vertex and index blobs, each starting at
+// a multiple of meshFileAlignment from the start of the file. All fields are
+// little-endian and vertices use the runtime Vertex layout. Indices are 2 or 4 bytes
+// wide, whichever addresses every vertex, and hold every level of detail back to back.
+struct MeshFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexStride;
+	uint32_t indexSize;
+	uint64_t vertexCount;
+	uint64_t vertexOffset;
+	uint64_t indexCount;
+	uint64_t indexOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundsCenter[3];
+	float boundsRadius;
+	uint32_t lodCount;
+	MeshLod lods[maxMeshLods];
+	uint8_t reserved[4];
+};
+
+static_assert(sizeof(MeshFileHeader) == 128, "mesh file header layout changed");
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+	const uint8_t* _data = nullptr;
+	size_t _size = 0;
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	int _fd = -1;
+#endif
+public:
+	MappedFile(const std::string& path);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	const uint8_t* data() const;
+	size_t size() const;
+};
+
+// Indices of either width.
+struct IndexData {
+	const void* data = nullptr;
+	size_t count = 0;
+	uint32_t size = sizeof(uint16_t);
+
+	IndexData() = default;
+	IndexData(std::span<const uint16_t> indices);
+	IndexData(std::span<const uint32_t> indices);
+	IndexData(const void* data, size_t count, uint32_t size);
+
+	size_t size_bytes() const;
+	uint32_t operator[](size_t i) const;
+};
+
+struct MeshView {
+	std::span<const Vertex> vertices;
+	IndexData indices;
+	Bounds bounds;
+	std::span<const MeshLod> lods;
+};
+
+// Validates a mapped cooked mesh and returns spans into the mapping, or nullopt if
+// the file is truncated or was written by a different format version.
+std::optional<MeshView> readMeshFile(const MappedFile& file);
+// Writes through a temporary file renamed into place, so a concurrent reader never
+// maps a half-written mesh.
+void writeMeshFile(const std::string& fileName, const MeshView& mesh);
@@ -0,0 +1,65 @@
+#include "meshimport.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <stdexcept>
+
+MeshView ImportedMesh::getView() const
+{
+	if (!shortIndices.empty()) {
+		return { vertices, IndexData(shortIndices), bounds, lods };
+	}
+	return { vertices, IndexData(indices), bounds, lods };
+}
+
+ImportedMesh importMesh(const std::string& fileName)
+{
+	ImportedMesh mesh;
+
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate);
+	if (!scene) {
+		throw std::runtime_error("failed to import " + fileName);
+	}
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		vertexCount += scene->mMeshes[i]->mNumVertices;
+		indexCount += 3 * (size_t)scene->mMeshes[i]->mNumFaces;
+	}
+	mesh.vertices.reserve(vertexCount);
+	mesh.indices.reserve(indexCount);
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* source = scene->mMeshes[i];
+		uint32_t baseVertex = (uint32_t)mesh.vertices.size();
+		for (unsigned k = 0; k < source->mNumVertices; k++) {
+			const aiVector3D vertex = source->mVertices[k];
+			const aiVector3D normal = source->mNormals[k];
+			Vertex vert;
+			vert.pos = { vertex.x, vertex.y, vertex.z };
+			vert.normal = { normal.x, normal.y, normal.z };
+			mesh.vertices.push_back(vert);
+		}
+		for (unsigned k = 0; k < source->mNumFaces; k++) {
+			if (source->mFaces[k].mNumIndices != 3) {
+				continue;
+			}
+			mesh.indices.push_back(baseVertex + source->mFaces[k].mIndices[0]);
+			mesh.indices.push_back(baseVertex + source->mFaces[k].mIndices[1]);
+			mesh.indices.push_back(baseVertex + source->mFaces[k].mIndices[2]);
+		}
+	}
+
+	mesh.stats = optimizeMesh(mesh.vertices, mesh.indices, mesh.lods);
+	if (getIndexSize(mesh.vertices.size()) == sizeof(uint16_t)) {
+		mesh.shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+		mesh.indices = {};
+	}
+	mesh.bounds = Bounds::fromVertices(mesh.vertices);
+
+	return mesh;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "meshfile.h"
+#include "meshoptimize.h"
+
+#include <string>
+#include <vector>
+
+
+struct ImportedMesh {
+	std::vector<Vertex> vertices;
+	// Only one of these is filled, depending on getIndexSize(vertices.size()).
+	std::vector<uint16_t> shortIndices;
+	std::vector<uint32_t> indices;
+	Bounds bounds;
+	std::vector<MeshLod> lods;
+	MeshOptimizationStats stats;
+
+	MeshView getView() const;
+};
+
+// Imports every mesh in a source asset (FBX, OBJ, ...) with Assimp into a single
+// triangle list, deduplicated, reordered and given levels of detail by optimizeMesh.
+ImportedMesh importMesh(const std::string& fileName);
@@ -0,0 +1,329 @@
+#include "meshoptimize.h"
+
+#include "meshsimplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+float computeAcmr(std::span<const uint32_t> indices, size_t vertexCount, size_t cacheSize)
+{
+	if (indices.size() < 3) {
+		return 0;
+	}
+	// A vertex is cached while fewer than cacheSize misses happened since it was loaded.
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	size_t time = cacheSize + 1;
+	size_t misses = 0;
+	for (uint32_t index : indices) {
+		if (time - loadedAt[index] > cacheSize) {
+			loadedAt[index] = time++;
+			misses++;
+		}
+	}
+	return (float)misses / (float)(indices.size() / 3);
+}
+
+namespace {
+
+struct VertexHash {
+	size_t operator()(const Vertex& vertex) const {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		const uint8_t* bytes = (const uint8_t*)&vertex;
+		for (size_t i = 0; i < sizeof(Vertex); i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+		return (size_t)hash;
+	}
+};
+
+struct VertexEqual {
+	bool operator()(const Vertex& a, const Vertex& b) const {
+		return memcmp(&a, &b, sizeof(Vertex)) == 0;
+	}
+};
+
+constexpr size_t forsythCacheSize = 32;
+
+float getVertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+	float score = 0;
+	if (cachePosition >= 0) {
+		// The last triangle's vertices score the same, so the next one doesn't just
+		// reuse its edge.
+		if (cachePosition < 3) {
+			score = 0.75f;
+		}
+		else {
+			float scale = 1.0f / (float)(forsythCacheSize - 3);
+			score = std::pow(1.0f - (float)(cachePosition - 3) * scale, 1.5f);
+		}
+	}
+	// Favour finishing vertices with few triangles left, so they leave the cache for good.
+	return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+}
+
+void deduplicateVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> unique;
+	unique.reserve(vertices.size());
+	std::vector<uint32_t> remap(vertices.size());
+	std::vector<Vertex> merged;
+	merged.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		auto [it, inserted] = unique.try_emplace(vertices[i], (uint32_t)merged.size());
+		if (inserted) {
+			merged.push_back(vertices[i]);
+		}
+		remap[i] = it->second;
+	}
+	for (uint32_t& index : indices) {
+		index = remap[index];
+	}
+	vertices.swap(merged);
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles adjacent to each vertex. The first remaining[v] entries of a vertex
+	// are the ones not emitted yet.
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t index : indices) {
+		remaining[index]++;
+	}
+	std::vector<size_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (size_t k = 0; k < 3; k++) {
+				adjacency[cursor[indices[t * 3 + k]]++] = (uint32_t)t;
+			}
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		vertexScores[v] = getVertexScore(-1, remaining[v]);
+	}
+	std::vector<bool> emitted(triangleCount, false);
+
+	auto getTriangleScore = [&](size_t t) {
+		return vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	};
+
+	size_t best = 0;
+	float bestScore = -1.0f;
+	for (size_t t = 0; t < triangleCount; t++) {
+		float score = getTriangleScore(t);
+		if (score > bestScore) {
+			best = t;
+			bestScore = score;
+		}
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> nextCache;
+	cache.reserve(forsythCacheSize + 3);
+	nextCache.reserve(forsythCacheSize + 3);
+	size_t scanCursor = 0;
+
+	while (output.size() < indices.size()) {
+		if (bestScore < 0) {
+			// Nothing in the cache has triangles left; restart from the next unemitted one.
+			while (emitted[scanCursor]) {
+				scanCursor++;
+			}
+			best = scanCursor;
+		}
+
+		const uint32_t* triangle = &indices[best * 3];
+		emitted[best] = true;
+		nextCache.clear();
+		for (size_t k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			output.push_back(v);
+			if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end()) {
+				nextCache.push_back(v);
+			}
+
+			size_t begin = offsets[v];
+			size_t end = begin + remaining[v];
+			auto it = std::find(adjacency.begin() + begin, adjacency.begin() + end, (uint32_t)best);
+			std::iter_swap(it, adjacency.begin() + end - 1);
+			remaining[v]--;
+		}
+		for (uint32_t v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				nextCache.push_back(v);
+			}
+		}
+
+		for (size_t i = 0; i < nextCache.size(); i++) {
+			uint32_t v = nextCache[i];
+			cachePosition[v] = i < forsythCacheSize ? (int)i : -1;
+			vertexScores[v] = getVertexScore(cachePosition[v], remaining[v]);
+		}
+
+		bestScore = -1.0f;
+		for (uint32_t v : nextCache) {
+			for (size_t a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+				uint32_t t = adjacency[a];
+				float score = getTriangleScore(t);
+				if (score > bestScore) {
+					best = t;
+					bestScore = score;
+				}
+			}
+		}
+
+		if (nextCache.size() > forsythCacheSize) {
+			nextCache.resize(forsythCacheSize);
+		}
+		cache.swap(nextCache);
+	}
+
+	indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, std::span<const Vertex> vertices)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+
+	// Clusters start wherever a triangle misses the cache on all three vertices, so
+	// reordering them costs little locality.
+	std::vector<size_t> clusterStarts;
+	std::vector<size_t> loadedAt(vertices.size(), 0);
+	size_t time = acmrCacheSize + 1;
+	for (size_t t = 0; t < triangleCount; t++) {
+		int misses = 0;
+		for (size_t k = 0; k < 3; k++) {
+			uint32_t index = indices[t * 3 + k];
+			if (time - loadedAt[index] > acmrCacheSize) {
+				loadedAt[index] = time++;
+				misses++;
+			}
+		}
+		if (t == 0 || misses == 3) {
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+	size_t clusterCount = clusterStarts.size() - 1;
+	if (clusterCount < 2) {
+		return;
+	}
+
+	// Area-weighted centroid and normal of each cluster and of the whole mesh.
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0;
+	for (size_t c = 0; c < clusterCount; c++) {
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			glm::vec3 a = vertices[indices[t * 3]].pos;
+			glm::vec3 b = vertices[indices[t * 3 + 1]].pos;
+			glm::vec3 d = vertices[indices[t * 3 + 2]].pos;
+			glm::vec3 normal = glm::cross(b - a, d - a);
+			float area = glm::length(normal);
+			glm::vec3 centroid = (a + b + d) / 3.0f;
+			centroids[c] += centroid * area;
+			normals[c] += normal;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+	}
+	if (meshArea > 0) {
+		meshCentroid /= meshArea;
+	}
+
+	std::vector<float> keys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		glm::vec3 centroid = areas[c] > 0 ? centroids[c] / areas[c] : centroids[c];
+		float length = glm::length(normals[c]);
+		glm::vec3 normal = length > 0 ? normals[c] / length : normals[c];
+		keys[c] = glm::dot(centroid - meshCentroid, normal);
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (size_t c : order) {
+		output.insert(output.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+	indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), std::numeric_limits<uint32_t>::max());
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (uint32_t& index : indices) {
+		if (remap[index] == std::numeric_limits<uint32_t>::max()) {
+			remap[index] = (uint32_t)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(reordered);
+}
+
+uint32_t getIndexSize(size_t vertexCount)
+{
+	return vertexCount <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+MeshOptimizationStats optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshLod>& lods)
+{
+	MeshOptimizationStats stats;
+	stats.vertexBytesBefore = vertices.size() * sizeof(Vertex);
+	stats.indexBytesBefore = indices.size() * getIndexSize(vertices.size());
+
+	deduplicateVertices(vertices, indices);
+	stats.acmrBefore = computeAcmr(indices, vertices.size());
+
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, vertices);
+	stats.acmrAfter = computeAcmr(indices, vertices.size());
+
+	std::vector<float> errors;
+	buildLodChain(vertices, indices, lods, errors);
+	for (size_t l = 0; l < lods.size(); l++) {
+		stats.lodTriangles[l] = lods[l].indexCount / 3;
+		stats.lodErrors[l] = errors[l];
+	}
+	optimizeVertexFetch(vertices, indices);
+
+	stats.vertexBytesAfter = vertices.size() * sizeof(Vertex);
+	stats.indexBytesAfter = indices.size() * getIndexSize(vertices.size());
+	return stats;
+}
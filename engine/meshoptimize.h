@@ -0,0 +1,48 @@
+#pragma once
+
+#include "meshfile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+struct MeshOptimizationStats {
+	// Average cache miss ratio (transformed vertices per triangle) of a 16 entry FIFO
+	// cache, for the deduplicated mesh in import order and after reordering.
+	float acmrBefore = 0;
+	float acmrAfter = 0;
+	size_t vertexBytesBefore = 0;
+	size_t vertexBytesAfter = 0;
+	size_t indexBytesBefore = 0;
+	size_t indexBytesAfter = 0;
+	// Triangles and simplification error, in model units, of each level of detail.
+	size_t lodTriangles[maxMeshLods] = {};
+	float lodErrors[maxMeshLods] = {};
+};
+
+constexpr size_t acmrCacheSize = 16;
+
+float computeAcmr(std::span<const uint32_t> indices, size_t vertexCount, size_t cacheSize = acmrCacheSize);
+
+// Merges bitwise identical vertices and rewrites the indices to match.
+void deduplicateVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+// Reorders triangles for the post-transform cache with Forsyth's linear-speed
+// algorithm, simulating a 32 entry LRU cache.
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+// Splits the cache-ordered triangles into clusters where the cache restarts and
+// sorts the clusters so outward-facing ones are drawn first, which reduces overdraw
+// at the cost of a few misses at each cluster boundary.
+void optimizeOverdraw(std::vector<uint32_t>& indices, std::span<const Vertex> vertices);
+// Reorders vertices by first use so vertex fetch walks memory linearly, dropping
+// vertices no triangle references.
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// Runs every step above in order, appending the level of detail chain of
+// buildLodChain before vertices are reordered for fetch. Byte counts assume each
+// mesh is stored with the narrowest index width that addresses its vertices and
+// include every level.
+MeshOptimizationStats optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshLod>& lods);
+// Index width needed to address vertexCount vertices.
+uint32_t getIndexSize(size_t vertexCount);
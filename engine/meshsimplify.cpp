@@ -0,0 +1,253 @@
+#include "meshsimplify.h"
+
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// A simplified level must drop below this fraction of the previous level's
+// triangles to be worth keeping.
+static constexpr float minLodReduction = 0.8f;
+// Collapses that turn a triangle's normal by more than about 75 degrees are rejected.
+static constexpr float minNormalAgreement = 0.25f;
+
+namespace {
+
+// Sum of squared distances to a set of area-weighted planes, as the symmetric 4x4
+// matrix of Garland and Heckbert.
+struct Quadric {
+	double xx = 0, xy = 0, xz = 0, xw = 0;
+	double yy = 0, yz = 0, yw = 0;
+	double zz = 0, zw = 0;
+	double ww = 0;
+	double weight = 0;
+
+	void addPlane(double a, double b, double c, double d, double w) {
+		xx += w * a * a; xy += w * a * b; xz += w * a * c; xw += w * a * d;
+		yy += w * b * b; yz += w * b * c; yw += w * b * d;
+		zz += w * c * c; zw += w * c * d;
+		ww += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& q) {
+		xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+		yy += q.yy; yz += q.yz; yw += q.yw;
+		zz += q.zz; zw += q.zw;
+		ww += q.ww;
+		weight += q.weight;
+	}
+
+	double evaluate(const glm::vec3& p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double value = xx * x * x + yy * y * y + zz * z * z + ww
+			+ 2 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z);
+		return std::max(value, 0.0);
+	}
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+}
+
+static glm::vec3 getTriangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	return glm::cross(b - a, c - a);
+}
+
+static std::vector<Quadric> computeQuadrics(std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+{
+	std::vector<Quadric> quadrics(vertices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		const glm::vec3& a = vertices[indices[t]].pos;
+		glm::vec3 normal = getTriangleNormal(a, vertices[indices[t + 1]].pos, vertices[indices[t + 2]].pos);
+		float length = glm::length(normal);
+		if (length == 0.0f) {
+			continue;
+		}
+		normal = normal / length;
+		double d = -glm::dot(normal, a);
+		for (int k = 0; k < 3; k++) {
+			quadrics[indices[t + k]].addPlane(normal.x, normal.y, normal.z, d, length * 0.5f);
+		}
+	}
+	return quadrics;
+}
+
+// Locks both ends of every edge used by exactly one triangle.
+static std::vector<bool> findLockedVertices(size_t vertexCount, std::span<const uint32_t> indices)
+{
+	std::vector<std::pair<uint32_t, uint32_t>> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = indices[t + k];
+			uint32_t b = indices[t + (k + 1) % 3];
+			edges.push_back({ std::min(a, b), std::max(a, b) });
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<bool> locked(vertexCount, false);
+	for (size_t i = 0; i < edges.size();) {
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i]) {
+			j++;
+		}
+		if (j - i == 1) {
+			locked[edges[i].first] = true;
+			locked[edges[i].second] = true;
+		}
+		i = j;
+	}
+	return locked;
+}
+
+std::vector<uint32_t> simplifyMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices, size_t targetIndexCount, float& error)
+{
+	std::vector<uint32_t> result(indices.begin(), indices.end());
+	std::vector<Quadric> quadrics = computeQuadrics(vertices, indices);
+	std::vector<bool> locked = findLockedVertices(vertices.size(), indices);
+	error = 0.0f;
+
+	std::vector<uint32_t> remap(vertices.size());
+	std::vector<bool> touched(vertices.size());
+	std::vector<uint32_t> triangleOffsets(vertices.size() + 1);
+	std::vector<uint32_t> vertexTriangles;
+	std::vector<Collapse> collapses;
+
+	while (result.size() > targetIndexCount) {
+		// Vertex to triangle adjacency, as offsets into vertexTriangles.
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (uint32_t index : result) {
+			triangleOffsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertices.size(); v++) {
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		}
+		vertexTriangles.resize(result.size());
+		std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++) {
+			vertexTriangles[fill[result[i]]++] = (uint32_t)(i / 3);
+		}
+
+		// Cheapest direction of every collapsible edge. Interior edges show up once
+		// per adjacent triangle; the duplicates fail the touched check below.
+		collapses.clear();
+		for (size_t t = 0; t < result.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = result[t + k];
+				uint32_t b = result[t + (k + 1) % 3];
+				if (locked[a] && locked[b]) {
+					continue;
+				}
+				Quadric sum = quadrics[a];
+				sum.add(quadrics[b]);
+				double toB = locked[a] ? INFINITY : sum.evaluate(vertices[b].pos);
+				double toA = locked[b] ? INFINITY : sum.evaluate(vertices[a].pos);
+				if (toB <= toA && !locked[a]) {
+					collapses.push_back({ a, b, toB });
+				}
+				else if (!locked[b]) {
+					collapses.push_back({ b, a, toA });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+			return x.cost < y.cost;
+		});
+
+		for (size_t v = 0; v < vertices.size(); v++) {
+			remap[v] = (uint32_t)v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+		size_t removeGoal = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		double passCost = 0;
+		for (const Collapse& collapse : collapses) {
+			if (removed >= removeGoal) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			// Reject collapses that would flip or sharply fold a remaining triangle.
+			bool valid = true;
+			size_t degenerate = 0;
+			for (uint32_t n = triangleOffsets[collapse.from]; n < triangleOffsets[collapse.from + 1] && valid; n++) {
+				const uint32_t* triangle = &result[vertexTriangles[n] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+					degenerate++;
+					continue;
+				}
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				for (int k = 0; k < 3; k++) {
+					before[k] = vertices[triangle[k]].pos;
+					after[k] = triangle[k] == collapse.from ? vertices[collapse.to].pos : before[k];
+				}
+				glm::vec3 oldNormal = getTriangleNormal(before[0], before[1], before[2]);
+				glm::vec3 newNormal = getTriangleNormal(after[0], after[1], after[2]);
+				float lengths = glm::length(oldNormal) * glm::length(newNormal);
+				valid = lengths > 0.0f && glm::dot(oldNormal, newNormal) >= minNormalAgreement * lengths;
+			}
+			if (!valid) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			// Neighbours' adjacency is stale until the next pass, so freeze them.
+			for (uint32_t n = triangleOffsets[collapse.from]; n < triangleOffsets[collapse.from + 1]; n++) {
+				const uint32_t* triangle = &result[vertexTriangles[n] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+			removed += degenerate;
+			double weight = quadrics[collapse.to].weight;
+			passCost = std::max(passCost, weight > 0 ? collapse.cost / weight : 0.0);
+		}
+		if (removed == 0) {
+			break;
+		}
+		error = std::max(error, (float)std::sqrt(passCost));
+
+		size_t write = 0;
+		for (size_t t = 0; t < result.size(); t += 3) {
+			uint32_t a = remap[result[t]];
+			uint32_t b = remap[result[t + 1]];
+			uint32_t c = remap[result[t + 2]];
+			if (a != b && b != c && a != c) {
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+	}
+	return result;
+}
+
+void buildLodChain(std::span<const Vertex> vertices, std::vector<uint32_t>& indices, std::vector<MeshLod>& lods, std::vector<float>& errors)
+{
+	lods = { { 0, (uint32_t)indices.size() } };
+	errors = { 0.0f };
+	std::vector<uint32_t> previous = indices;
+	while (lods.size() < maxMeshLods) {
+		float error = 0.0f;
+		std::vector<uint32_t> level = simplifyMesh(vertices, previous, previous.size() / 6 * 3, error);
+		if (level.empty() || level.size() > previous.size() * minLodReduction) {
+			break;
+		}
+		optimizeVertexCache(level, vertices.size());
+		lods.push_back({ (uint32_t)indices.size(), (uint32_t)level.size() });
+		errors.push_back(std::max(error, errors.back()));
+		indices.insert(indices.end(), level.begin(), level.end());
+		previous = std::move(level);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "meshfile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+// Reduces a triangle list towards targetIndexCount indices by collapsing edges onto
+// one of their endpoints in order of quadric error (Garland and Heckbert). Vertices
+// are never moved or created, so the result indexes the same vertex array. Vertices
+// on open edges, which includes the normal seams left by deduplication, are locked
+// so holes and seams never crack. Writes the largest collapse error, as a distance
+// in model units, to error.
+std::vector<uint32_t> simplifyMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices, size_t targetIndexCount, float& error);
+
+// Treats indices as the full detail level and appends up to maxMeshLods - 1
+// simplified levels after it, each aiming for half the triangles of the one before.
+// Each level is reordered for the vertex cache. Stops early once simplification
+// stalls. lods receives every level, including the first.
+void buildLodChain(std::span<const Vertex> vertices, std::vector<uint32_t>& indices, std::vector<MeshLod>& lods, std::vector<float>& errors);
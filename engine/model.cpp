@@ -1,79 +1,131 @@
 #include "model.h"
 
-vk::VertexInputBindingDescription Vertex::getVertexDescription()
+#include "cpuprofiler.h"
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+std::string Model::getCookedPath(const std::string& fileName)
 {
-	return vk::VertexInputBindingDescription()
-		.setBinding(0)
-		.setStride(sizeof(Vertex))
-		.setInputRate(vk::VertexInputRate::eVertex);
+	return std::filesystem::path(fileName).replace_extension(".mesh").string();
 }
 
-std::array<vk::VertexInputAttributeDescription, 2> Vertex::getAttributeDescriptions()
+Model Model::loadFromFile(std::string fileName)
 {
-	return {
-		vk::VertexInputAttributeDescription()
-			.setBinding(0)
-			.setLocation(0)
-			.setFormat(vk::Format::eR32G32B32Sfloat)
-			.setOffset(offsetof(Vertex, pos)),
-		vk::VertexInputAttributeDescription()
-			.setBinding(0)
-			.setLocation(1)
-			.setFormat(vk::Format::eR32G32B32Sfloat)
-			.setOffset(offsetof(Vertex, normal))
-	};
+	PROFILE_ZONE("Model::loadFromFile");
+	std::string cookedPath = getCookedPath(fileName);
+
+	std::error_code error;
+	auto sourceTime = std::filesystem::last_write_time(fileName, error);
+	bool sourceExists = !error;
+	auto cookedTime = std::filesystem::last_write_time(cookedPath, error);
+	bool cookedFresh = !error && (!sourceExists || cookedTime >= sourceTime);
+	if (cookedFresh) {
+		if (std::optional<Model> model = loadCooked(cookedPath)) {
+			return std::move(*model);
+		}
+	}
+
+	Model model = importFromFile(fileName);
+	try {
+		model.saveCooked(cookedPath);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "could not cook " << fileName << ": " << e.what() << std::endl;
+	}
+	return model;
 }
 
-Model Model::loadFromFile(std::string fileName)
+Model Model::importFromFile(const std::string& fileName)
 {
 	Model model;
+	model.imported = importMesh(fileName);
+	model.vertexData = model.imported.vertices;
+	model.indexData = model.imported.getView().indices;
+	model.bounds = model.imported.bounds;
+	model.lods = model.imported.lods;
+	return model;
+}
 
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate);
-	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-		const aiMesh* mesh = scene->mMeshes[i];
-		for (unsigned k = 0; k < mesh->mNumVertices; k++) {
-			const aiVector3D vertex = mesh->mVertices[k];
-			const aiVector3D normal = mesh->mNormals[k];
-			Vertex vert;
-			vert.pos = { vertex.x, vertex.y, vertex.z };
-			vert.normal = { normal.x, normal.y, normal.z };
-			model.vertices.push_back(vert);
-		}
-		for (unsigned k = 0; k < mesh->mNumFaces; k++) {
-			model.indices.push_back(mesh->mFaces[k].mIndices[0]);
-			model.indices.push_back(mesh->mFaces[k].mIndices[1]);
-			model.indices.push_back(mesh->mFaces[k].mIndices[2]);
-		}
+std::optional<Model> Model::loadCooked(const std::string& fileName)
+{
+	Model model;
+	try {
+		model.mapping = std::make_unique<MappedFile>(fileName);
+	}
+	catch (const std::exception&) {
+		return std::nullopt;
 	}
 
+	std::optional<MeshView> mesh = readMeshFile(*model.mapping);
+	if (!mesh) {
+		return std::nullopt;
+	}
+	model.vertexData = mesh->vertices;
+	model.indexData = mesh->indices;
+	model.bounds = mesh->bounds;
+	model.lods = mesh->lods;
 	return model;
 }
 
-void BakedModel::destroy(const VulkanContext& vkCtx)
+void Model::saveCooked(const std::string& fileName) const
 {
-	vertices.destroy(vkCtx);
-	indices.destroy(vkCtx);
+	writeMeshFile(fileName, { vertexData, indexData, bounds, lods });
 }
 
-void submitModelBake(const VulkanContext& vkCtx, AsyncTransferHandler& transferHandler, const std::vector<Model>& models, std::vector<BakedModel>& bakedModels)
+void Model::quantize()
 {
-	for (int i = 0; i < bakedModels.size(); i++) {
-		bakedModels[i].vertices = Buffer<Vertex>(vkCtx, models[i].vertices.size(), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst);
-		bakedModels[i].indices = Buffer<uint16_t>(vkCtx, models[i].indices.size(), vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst);
+	dequantization = quantizeVertices(vertexData, bounds, compactVertices);
+}
+
+std::span<const uint8_t> Model::getVertexBytes(VertexFormat format) const
+{
+	if (format == VertexFormat::Compact) {
+		if (compactVertices.size() != vertexData.size()) {
+			throw std::runtime_error("model was not quantized for a compact vertex pool");
+		}
+		return { (const uint8_t*)compactVertices.data(), compactVertices.size() * sizeof(CompactVertex) };
 	}
+	return { (const uint8_t*)vertexData.data(), vertexData.size_bytes() };
+}
+
+bool BakedModel::isReady() const
+{
+	return geometry.indexCount > 0;
+}
 
-	transferHandler.beginTransferCommand();
+TransferToken submitModelBake(GeometryPool& geometry, AsyncTransferHandler& transferHandler, const std::vector<Model>& models, std::vector<BakedModel>& bakedModels)
+{
+	PROFILE_ZONE("submitModelBake");
+	// Allocate everything before staging anything, so a full pool leaves neither
+	// allocations nor transfers behind.
+	for (int i = 0; i < bakedModels.size(); i++) {
+		const auto& model = models[i];
+		vk::IndexType indexType = model.indexData.size == sizeof(uint32_t) ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
+		try {
+			bakedModels[i].geometry = geometry.allocate((uint32_t)model.vertexData.size(), (uint32_t)model.indexData.count, indexType);
+		}
+		catch (...) {
+			for (int j = 0; j < i; j++) {
+				geometry.free(bakedModels[j].geometry);
+			}
+			throw;
+		}
+	}
 	for (int i = 0; i < bakedModels.size(); i++) {
 		const auto& model = models[i];
 		auto& bakedModel = bakedModels[i];
-
-		if (!transferHandler.canFit(sizeof(Vertex) * model.vertices.size() + sizeof(uint16_t) * model.indices.size())) {
-			transferHandler.resetAndSubmitPool();
-			transferHandler.beginTransferCommand();
+		vk::IndexType indexType = model.indexData.size == sizeof(uint32_t) ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
+		bakedModel.bounds = model.bounds;
+		bakedModel.dequantization = model.dequantization;
+		bakedModel.lodCount = (uint32_t)model.lods.size();
+		for (size_t l = 0; l < model.lods.size(); l++) {
+			bakedModel.lods[l] = { bakedModel.geometry.firstIndex + model.lods[l].firstIndex, model.lods[l].indexCount };
 		}
-		transferHandler.addTransfer(model.vertices.data(), sizeof(Vertex) * model.vertices.size(), bakedModel.vertices.data);
-		transferHandler.addTransfer(model.indices.data(), sizeof(uint16_t) * model.indices.size(), bakedModel.indices.data);
+
+		transferHandler.addTransfer(model.getVertexBytes(geometry.getVertexFormat()), geometry.getVertexBuffer(), bakedModel.geometry.vertexOffset * geometry.getVertexSize());
+		transferHandler.addTransfer(model.indexData.data, model.indexData.size_bytes(), geometry.getIndexBuffer(indexType), bakedModel.geometry.firstIndex * model.indexData.size);
 	}
-	transferHandler.resetAndSubmitPool();
-}
\ No newline at end of file
+	return transferHandler.submit();
+}
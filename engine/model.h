@@ -4,34 +4,70 @@
 #include <span>
 #include "vulkancontext.h"
 #include "asynctransferhandler.h"
-#include <fstream>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>         
-#include <assimp/postprocess.h> 
-
-struct Vertex {
-	glm::vec3 pos;
-	glm::vec3 normal;
-
-	static vk::VertexInputBindingDescription getVertexDescription();
-
-
-	static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions();
-};
+#include "geometrypool.h"
+#include "meshfile.h"
+#include "meshimport.h"
+#include "vertexformat.h"
+#include <array>
+#include <memory>
+#include <optional>
 
 struct Model
 {
-	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	// Storage for imported meshes. Cooked meshes leave this empty and point the
+	// spans into the mapped file instead.
+	ImportedMesh imported;
+	std::unique_ptr<MappedFile> mapping;
 
+	std::span<const Vertex> vertexData;
+	IndexData indexData;
+	Bounds bounds;
+	// Ranges of indexData, from full detail down.
+	std::span<const MeshLod> lods;
+	// Filled by quantize() for pools that store compact vertices.
+	std::vector<CompactVertex> compactVertices;
+	Dequantization dequantization;
+
+	Model() = default;
+	Model(Model&&) = default;
+	Model& operator=(Model&&) = default;
+
+	static std::string getCookedPath(const std::string& fileName);
+	// Maps the cooked mesh next to fileName, importing the source with Assimp and
+	// writing the cooked mesh if it is missing, stale or unreadable.
 	static Model loadFromFile(std::string fileName);
+	static Model importFromFile(const std::string& fileName);
+	static std::optional<Model> loadCooked(const std::string& fileName);
+	void saveCooked(const std::string& fileName) const;
+
+	void quantize();
+	// Vertex bytes in the given format. Compact requires quantize() to have run.
+	std::span<const uint8_t> getVertexBytes(VertexFormat format) const;
 };
 
+// Projected radius of a model's bounding sphere, as a fraction of half the viewport
+// height, below which each level of detail past the first is drawn.
+constexpr float lodScreenSizes[maxMeshLods - 1] = { 0.2f, 0.1f, 0.05f };
+// How far, as a fraction of the threshold, the projected size must pass a threshold
+// before an instance changes level.
+constexpr float lodHysteresis = 0.1f;
+
+// A model resident in the renderer's geometry pool.
 struct BakedModel {
-	Buffer<Vertex> vertices;
-	Buffer<uint16_t> indices;
+	GeometryAllocation geometry;
+	Bounds bounds;
+	// Pushed before drawing from a compact pool.
+	Dequantization dequantization;
+	// Index ranges of each level of detail within the pool's index buffer.
+	std::array<MeshLod, maxMeshLods> lods{};
+	uint32_t lodCount = 0;
 
-	void destroy(const VulkanContext& vkCtx);
+	// False until the model's upload has been submitted.
+	bool isReady() const;
 };
 
-void submitModelBake(const VulkanContext& vkCtx, AsyncTransferHandler& transferHandler, const std::vector<Model>& models, std::vector<BakedModel>& bakedModels);
\ No newline at end of file
+// Stages the models for upload and returns the token of the submission. The source
+// models may be released right away, but the baked buffers are not ready for use
+// until the token completes. Throws, having staged nothing, if the pool cannot hold
+// every model.
+TransferToken submitModelBake(GeometryPool& geometry, AsyncTransferHandler& transferHandler, const std::vector<Model>& models, std::vector<BakedModel>& bakedModels);
\ No newline at end of file
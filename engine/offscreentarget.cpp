@@ -0,0 +1,103 @@
+#include "offscreentarget.h"
+
+OffscreenTarget::OffscreenTarget(const VulkanContext& vkCtx, uint32_t width, uint32_t height, uint32_t imageCount, vk::Format format) :
+	_vkCtx(vkCtx),
+	_extent(width, height),
+	_format(format)
+{
+	auto info = vk::ImageCreateInfo()
+		.setArrayLayers(1)
+		.setExtent(vk::Extent3D(width, height, 1))
+		.setFormat(format)
+		.setImageType(vk::ImageType::e2D)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setSharingMode(vk::SharingMode::eExclusive)
+		.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc)
+		.setMipLevels(1)
+		.setSamples(vk::SampleCountFlagBits::e1)
+		.setTiling(vk::ImageTiling::eOptimal);
+
+	VmaAllocationCreateInfo allocCreateInfo{};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	_allocations.resize(imageCount);
+	_images.resize(imageCount);
+	_imageViews.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++) {
+		vmaCreateImage(vkCtx.getAllocator(), (VkImageCreateInfo*)&info, &allocCreateInfo, (VkImage*)&_images[i], &_allocations[i], nullptr);
+
+		auto viewInfo = vk::ImageViewCreateInfo()
+			.setImage(_images[i])
+			.setViewType(vk::ImageViewType::e2D)
+			.setComponents(vk::ComponentMapping())
+			.setFormat(format)
+			.setSubresourceRange(vk::ImageSubresourceRange()
+				.setAspectMask(vk::ImageAspectFlagBits::eColor)
+				.setBaseArrayLayer(0)
+				.setLayerCount(1)
+				.setBaseMipLevel(0)
+				.setLevelCount(1));
+		_imageViews[i] = vkCtx.getDevice().createImageView(viewInfo);
+	}
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+	for (uint32_t i = 0; i < _images.size(); i++) {
+		_vkCtx.deviceDestroy(_imageViews[i]);
+		vmaDestroyImage(_vkCtx.getAllocator(), _images[i], _allocations[i]);
+	}
+}
+
+vk::ImageLayout OffscreenTarget::getFinalLayout()
+{
+	return vk::ImageLayout::eTransferSrcOptimal;
+}
+
+int OffscreenTarget::getWidth() const
+{
+	return _extent.width;
+}
+
+int OffscreenTarget::getHeight() const
+{
+	return _extent.height;
+}
+
+vk::Viewport OffscreenTarget::getViewport() const
+{
+	return vk::Viewport()
+		.setX(0)
+		.setY(0)
+		.setWidth(getWidth())
+		.setHeight(getHeight())
+		.setMinDepth(0)
+		.setMaxDepth(1.0);
+}
+
+vk::Rect2D OffscreenTarget::getScissors() const
+{
+	return vk::Rect2D()
+		.setOffset({ 0, 0 })
+		.setExtent(_extent);
+}
+
+vk::Format OffscreenTarget::getFormat() const
+{
+	return _format;
+}
+
+const std::vector<vk::Image>& OffscreenTarget::getImages() const
+{
+	return _images;
+}
+
+const std::vector<vk::ImageView>& OffscreenTarget::getImageViews() const
+{
+	return _imageViews;
+}
+
+uint32_t OffscreenTarget::getImageCount() const
+{
+	return (uint32_t)_images.size();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "vulkancontext.h"
+
+
+class OffscreenTarget
+{
+	const VulkanContext& _vkCtx;
+	const vk::Extent2D _extent;
+	const vk::Format _format;
+	std::vector<VmaAllocation> _allocations;
+	std::vector<vk::Image> _images;
+	std::vector<vk::ImageView> _imageViews;
+
+public:
+	OffscreenTarget(const VulkanContext& vkCtx, uint32_t width, uint32_t height, uint32_t imageCount, vk::Format format = vk::Format::eR8G8B8A8Unorm);
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	~OffscreenTarget();
+
+	static vk::ImageLayout getFinalLayout();
+
+	int getWidth() const;
+	int getHeight() const;
+
+	vk::Viewport getViewport() const;
+	vk::Rect2D getScissors() const;
+	vk::Format getFormat() const;
+	const std::vector<vk::Image>& getImages() const;
+	const std::vector<vk::ImageView>& getImageViews() const;
+	uint32_t getImageCount() const;
+};
@@ -0,0 +1,122 @@
+#include "options.h"
+
+#include <stdexcept>
+
+EngineOptions EngineOptions::parse(int argc, char** argv)
+{
+	EngineOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto next = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				throw std::runtime_error("missing value for " + arg);
+			}
+			return argv[++i];
+		};
+
+		if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--bench-instances") {
+			options.headless = true;
+			options.benchInstances = true;
+		}
+		else if (arg == "--bench-recording") {
+			options.headless = true;
+			options.benchRecording = true;
+		}
+		else if (arg == "--bench-upload") {
+			options.headless = true;
+			options.benchUpload = true;
+		}
+		else if (arg == "--bench-lod") {
+			options.headless = true;
+			options.benchLod = true;
+		}
+		else if (arg == "--no-lod") {
+			options.lods = false;
+		}
+		else if (arg == "--staging-mb") {
+			options.stagingSize = std::stoul(next()) << 20;
+		}
+		else if (arg == "--compact-vertices") {
+			options.vertexFormat = VertexFormat::Compact;
+		}
+		else if (arg == "--pipeline-cache") {
+			options.pipelineCachePath = next();
+		}
+		else if (arg == "--no-pipeline-cache") {
+			options.pipelineCachePath.clear();
+		}
+		else if (arg == "--dynamic-resolution") {
+			options.resolutionBudget = std::stof(next());
+		}
+		else if (arg == "--min-resolution-scale") {
+			options.minResolutionScale = std::stof(next());
+			if (options.minResolutionScale <= 0.0f || options.minResolutionScale > 1.0f) {
+				throw std::runtime_error("minimum resolution scale must be in (0, 1]");
+			}
+		}
+		else if (arg == "--trace") {
+			options.tracePath = next();
+		}
+		else if (arg == "--hitch-ms") {
+			options.hitchMs = std::stof(next());
+			if (options.hitchMs <= 0.0f) {
+				throw std::runtime_error("hitch threshold must be positive");
+			}
+		}
+		else if (arg == "--record-threads") {
+			options.recordThreads = std::stoul(next());
+		}
+		else if (arg == "--frames") {
+			options.frames = std::stoi(next());
+		}
+		else if (arg == "--tick-rate") {
+			options.tickRate = std::stof(next());
+			if (options.tickRate <= 0.0f) {
+				throw std::runtime_error("tick rate must be positive");
+			}
+		}
+		else if (arg == "--snapshot-exchange") {
+			std::string mode = next();
+			if (mode == "mailbox") {
+				options.exchangeMode = ExchangeMode::Mailbox;
+			}
+			else if (mode == "mutex") {
+				options.exchangeMode = ExchangeMode::Mutex;
+			}
+			else {
+				throw std::runtime_error("unknown snapshot exchange " + mode);
+			}
+		}
+		else if (arg == "--cull") {
+			std::string mode = next();
+			if (mode == "cpu") {
+				options.cullMode = CullMode::Cpu;
+			}
+			else if (mode == "gpu") {
+				options.cullMode = CullMode::Gpu;
+			}
+			else if (mode == "gpu-verify") {
+				options.cullMode = CullMode::GpuVerify;
+			}
+			else {
+				throw std::runtime_error("unknown cull mode " + mode);
+			}
+		}
+		else if (arg == "--scene") {
+			options.scene = next();
+		}
+		else if (arg == "--width") {
+			options.width = (uint32_t)std::stoul(next());
+		}
+		else if (arg == "--height") {
+			options.height = (uint32_t)std::stoul(next());
+		}
+		else {
+			throw std::runtime_error("unknown option " + arg);
+		}
+	}
+	return options;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "asynctransferhandler.h"
+#include "dynamicresolution.h"
+#include "gpuculler.h"
+#include "latencyhistogram.h"
+#include "pipelinecache.h"
+#include "snapshotexchange.h"
+#include "vertexformat.h"
+
+#include <cstdint>
+#include <string>
+
+
+struct EngineOptions {
+	std::string scene = "scenes/scene.json";
+	bool headless = false;
+	bool benchInstances = false;
+	bool benchRecording = false;
+	bool benchUpload = false;
+	bool benchLod = false;
+	bool lods = true;
+	size_t recordThreads = 0;
+	int frames = 1000;
+	float tickRate = 60.0f;
+	ExchangeMode exchangeMode = ExchangeMode::Mailbox;
+	CullMode cullMode = CullMode::Cpu;
+	uint32_t width = 800;
+	uint32_t height = 600;
+	size_t stagingSize = defaultStagingSize;
+	VertexFormat vertexFormat = VertexFormat::Float;
+	// Empty to keep the pipeline cache in memory.
+	std::string pipelineCachePath = defaultPipelineCachePath;
+	// GPU frame time budget in milliseconds for dynamic resolution, 0 to disable.
+	float resolutionBudget = 0.0f;
+	float minResolutionScale = defaultMinResolutionScale;
+	// Chrome trace written on exit, and on F9 in windowed mode, when not empty.
+	std::string tracePath;
+	// Frame times above this many milliseconds are counted as hitches.
+	float hitchMs = defaultHitchMilliseconds;
+
+	static EngineOptions parse(int argc, char** argv);
+};
@@ -1,13 +1,13 @@
 #include "pipeline.h"
 
 #include "depthstencil.h"
-#include "model.h"
 
 #include <algorithm>
+#include <chrono>
 
-Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& swapchain, vk::ImageView depthView, DefaultUniformLayout& uniform)
+Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, vk::Format colorFormat, vk::Extent2D extent, const std::vector<vk::ImageView>& colorViews, vk::ImageLayout finalLayout, vk::ImageView depthView, DefaultUniformLayout& uniform, PipelineCache& cache, VertexFormat vertexFormat)
 {
-	Shader vertShader = Shader::loadShaderFromFile(vkCtx, "shaders/default.vert.spv");
+	Shader vertShader = Shader::loadShaderFromFile(vkCtx, getVertexShaderPath(vertexFormat));
 	Shader fragShader = Shader::loadShaderFromFile(vkCtx, "shaders/default.frag.spv");
 
 	auto vertStageInfo = vk::PipelineShaderStageCreateInfo()
@@ -22,8 +22,8 @@ Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& s
 
 	vk::PipelineShaderStageCreateInfo shaderStages[] = { vertStageInfo, fragStageInfo };
 
-	auto vertexInputBinding = Vertex::getVertexDescription();
-	auto vertexInputAttributes = Vertex::getAttributeDescriptions();
+	auto vertexInputBinding = getVertexDescription(vertexFormat);
+	auto vertexInputAttributes = getVertexAttributeDescriptions(vertexFormat);
 
 	auto vertexState = vk::PipelineVertexInputStateCreateInfo()
 		.setVertexAttributeDescriptionCount((uint32_t)vertexInputAttributes.size())
@@ -34,8 +34,16 @@ Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& s
 	auto vertexAssembly = vk::PipelineInputAssemblyStateCreateInfo()
 		.setPrimitiveRestartEnable(false)
 		.setTopology(vk::PrimitiveTopology::eTriangleList);
-	auto viewport = swapchain.getViewport();
-	auto scissors = swapchain.getScissors();
+	auto viewport = vk::Viewport()
+		.setX(0)
+		.setY(0)
+		.setWidth((float)extent.width)
+		.setHeight((float)extent.height)
+		.setMinDepth(0)
+		.setMaxDepth(1.0);
+	auto scissors = vk::Rect2D()
+		.setOffset({ 0, 0 })
+		.setExtent(extent);
 
 	auto viewportState = vk::PipelineViewportStateCreateInfo()
 		.setScissorCount(1)
@@ -43,6 +51,12 @@ Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& s
 		.setViewportCount(1)
 		.setPViewports(&viewport);
 
+	// Set per frame, as dynamic resolution renders into part of the framebuffer.
+	vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	auto dynamicState = vk::PipelineDynamicStateCreateInfo()
+		.setDynamicStateCount(2)
+		.setPDynamicStates(dynamicStates);
+
 	auto rasterizer = vk::PipelineRasterizationStateCreateInfo()
 		.setDepthClampEnable(false)
 		.setCullMode(vk::CullModeFlagBits::eBack)
@@ -78,19 +92,29 @@ Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& s
 		.setLogicOpEnable(false);
 	std::vector<vk::DescriptorSetLayout> layouts({ uniform.getSceneLayout(), uniform.getModelLayout() });
 
+	auto dequantizationRange = vk::PushConstantRange()
+		.setStageFlags(vk::ShaderStageFlagBits::eVertex)
+		.setOffset(0)
+		.setSize(sizeof(Dequantization));
+
 	auto pipelineInfo = vk::PipelineLayoutCreateInfo()
 		.setSetLayoutCount((uint32_t)layouts.size())
 		.setPSetLayouts(layouts.data());
+	if (vertexFormat == VertexFormat::Compact) {
+		pipelineInfo
+			.setPushConstantRangeCount(1)
+			.setPPushConstantRanges(&dequantizationRange);
+	}
 
 	vk::PipelineLayout pipelineLayout = vkCtx.getDevice().createPipelineLayout(pipelineInfo);
 
 	auto colorAttachment = vk::AttachmentDescription()
-		.setFormat(swapchain.getFormat().format)
+		.setFormat(colorFormat)
 		.setSamples(vk::SampleCountFlagBits::e1)
 		.setLoadOp(vk::AttachmentLoadOp::eClear)
 		.setStoreOp(vk::AttachmentStoreOp::eStore)
 		.setInitialLayout(vk::ImageLayout::eUndefined)
-		.setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+		.setFinalLayout(finalLayout);
 
 	auto depthAttachment = DepthStencil::getDepthAttachment();
 
@@ -107,20 +131,31 @@ Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& s
 		.setPColorAttachments(&colorAttachmentRef)
 		.setPDepthStencilAttachment(&depthAttachmentRef);
 
-	auto subpassDependencies = vk::SubpassDependency()
-		.setSrcSubpass(VK_SUBPASS_EXTERNAL)
-		.setDstSubpass(0)
-		.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
+	vk::SubpassDependency subpassDependencies[] = {
+		vk::SubpassDependency()
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite),
+		// Orders the transition to the final layout before a blit or copy reads the
+		// color attachment.
+		vk::SubpassDependency()
+			.setSrcSubpass(0)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstStageMask(vk::PipelineStageFlagBits::eTransfer)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+	};
 	vk::AttachmentDescription attachments[] = { colorAttachment, depthAttachment };
 	auto renderPassInfo = vk::RenderPassCreateInfo()
 		.setAttachmentCount(2)
 		.setPAttachments(attachments)
 		.setSubpassCount(1)
 		.setPSubpasses(&subpass)
-		.setDependencyCount(1)
-		.setPDependencies(&subpassDependencies);
+		.setDependencyCount(2)
+		.setPDependencies(subpassDependencies);
 
 	vk::RenderPass renderPass = vkCtx.getDevice().createRenderPass(renderPassInfo);
 	auto graphicsPipelineInfo = vk::GraphicsPipelineCreateInfo()
@@ -130,33 +165,37 @@ Pipeline Pipeline::createPipeline(const VulkanContext& vkCtx, const Swapchain& s
 		.setPInputAssemblyState(&vertexAssembly)
 		.setPColorBlendState(&colorBlendState)
 		.setPViewportState(&viewportState)
+		.setPDynamicState(&dynamicState)
 		.setPMultisampleState(&multiSampling)
 		.setPRasterizationState(&rasterizer)
 		.setPDepthStencilState(&depthStencilState)
 		.setLayout(pipelineLayout)
 		.setRenderPass(renderPass)
 		.setSubpass(0);
-	vk::Pipeline pipeline = vkCtx.getDevice().createGraphicsPipeline(vk::PipelineCache(), graphicsPipelineInfo);
+	auto creationStart = std::chrono::steady_clock::now();
+	vk::Pipeline pipeline = vkCtx.getDevice().createGraphicsPipeline(cache.getCache(), graphicsPipelineInfo);
+	cache.recordCreation(std::chrono::steady_clock::now() - creationStart);
 
-	std::vector<vk::Framebuffer> framebuffers(swapchain.getImageCount());
+	std::vector<vk::Framebuffer> framebuffers(colorViews.size());
 
-	std::transform(swapchain.getImageViews().begin(), swapchain.getImageViews().end(), framebuffers.begin(), [&](const vk::ImageView& imageView) {
+	std::transform(colorViews.begin(), colorViews.end(), framebuffers.begin(), [&](const vk::ImageView& imageView) {
 		vk::ImageView attachments[] = { imageView, depthView };
 		auto frameBufferInfo = vk::FramebufferCreateInfo()
 			.setAttachmentCount(2)
 			.setPAttachments(attachments)
 			.setRenderPass(renderPass)
-			.setWidth(swapchain.getWidth())
-			.setHeight(swapchain.getHeight())
+			.setWidth(extent.width)
+			.setHeight(extent.height)
 			.setLayers(1);
 		return vkCtx.getDevice().createFramebuffer(frameBufferInfo);
 		});
 
-	return Pipeline(vkCtx, scissors, pipeline, pipelineLayout, renderPass, framebuffers);
+	return Pipeline(vkCtx, vertexFormat, scissors, pipeline, pipelineLayout, renderPass, framebuffers);
 }
 
-Pipeline::Pipeline(const VulkanContext& vkCtx, vk::Rect2D scissors, vk::Pipeline pipeline, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, std::vector<vk::Framebuffer> framebuffers)
+Pipeline::Pipeline(const VulkanContext& vkCtx, VertexFormat vertexFormat, vk::Rect2D scissors, vk::Pipeline pipeline, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, std::vector<vk::Framebuffer> framebuffers)
 	: _vkCtx(vkCtx),
+	_vertexFormat(vertexFormat),
 	_scissors(scissors),
 	_pipeline(pipeline),
 	_pipelineLayout(pipelineLayout),
@@ -165,8 +204,13 @@ Pipeline::Pipeline(const VulkanContext& vkCtx, vk::Rect2D scissors, vk::Pipeline
 {
 }
 
-Pipeline::Pipeline(const VulkanContext& vkCtx, const Swapchain& swapchain, vk::ImageView depthView, DefaultUniformLayout& uniform)
-	: Pipeline(createPipeline(vkCtx, swapchain, depthView, uniform))
+Pipeline::Pipeline(const VulkanContext& vkCtx, const Swapchain& swapchain, vk::ImageView depthView, DefaultUniformLayout& uniform, PipelineCache& cache, VertexFormat vertexFormat)
+	: Pipeline(createPipeline(vkCtx, swapchain.getFormat().format, swapchain.getScissors().extent, swapchain.getImageViews(), vk::ImageLayout::ePresentSrcKHR, depthView, uniform, cache, vertexFormat))
+{
+}
+
+Pipeline::Pipeline(const VulkanContext& vkCtx, const OffscreenTarget& target, vk::ImageView depthView, DefaultUniformLayout& uniform, PipelineCache& cache, VertexFormat vertexFormat)
+	: Pipeline(createPipeline(vkCtx, target.getFormat(), target.getScissors().extent, target.getImageViews(), OffscreenTarget::getFinalLayout(), depthView, uniform, cache, vertexFormat))
 {
 }
 
@@ -190,6 +234,11 @@ vk::Rect2D Pipeline::getScissors() const
 	return _scissors;
 }
 
+VertexFormat Pipeline::getVertexFormat() const
+{
+	return _vertexFormat;
+}
+
 vk::Pipeline Pipeline::getPipeline() const
 {
 	return _pipeline;
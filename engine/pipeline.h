@@ -1,24 +1,29 @@
 #pragma once
 
 #include "defaultuniform.h"
+#include "offscreentarget.h"
+#include "pipelinecache.h"
 #include "shader.h"
 #include "swapchain.h"
+#include "vertexformat.h"
 #include "vulkancontext.h"
 
 
 class Pipeline
 {
 	const VulkanContext& _vkCtx;
+	const VertexFormat _vertexFormat;
 	const vk::Rect2D _scissors;
 	const vk::Pipeline _pipeline;
 	const vk::PipelineLayout _pipelineLayout;
 	const vk::RenderPass _renderPass;
 	const std::vector<vk::Framebuffer> _framebuffers;
 
-	static Pipeline createPipeline(const VulkanContext& vkCtx, const Swapchain& swapchain, vk::ImageView depthView, DefaultUniformLayout& uniform);
+	static Pipeline createPipeline(const VulkanContext& vkCtx, vk::Format colorFormat, vk::Extent2D extent, const std::vector<vk::ImageView>& colorViews, vk::ImageLayout finalLayout, vk::ImageView depthView, DefaultUniformLayout& uniform, PipelineCache& cache, VertexFormat vertexFormat);
 public:
-	Pipeline(const VulkanContext& vkCtx, vk::Rect2D _scissors, vk::Pipeline pipeline, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, std::vector<vk::Framebuffer> framebuffers);
-	Pipeline(const VulkanContext& vkCtx, const Swapchain& swapchain, vk::ImageView depthView, DefaultUniformLayout& uniform);
+	Pipeline(const VulkanContext& vkCtx, VertexFormat vertexFormat, vk::Rect2D _scissors, vk::Pipeline pipeline, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, std::vector<vk::Framebuffer> framebuffers);
+	Pipeline(const VulkanContext& vkCtx, const Swapchain& swapchain, vk::ImageView depthView, DefaultUniformLayout& uniform, PipelineCache& cache, VertexFormat vertexFormat = VertexFormat::Float);
+	Pipeline(const VulkanContext& vkCtx, const OffscreenTarget& target, vk::ImageView depthView, DefaultUniformLayout& uniform, PipelineCache& cache, VertexFormat vertexFormat = VertexFormat::Float);
 	Pipeline(Pipeline&) = delete;
 	~Pipeline();
 
@@ -26,6 +31,8 @@ public:
 	vk::Rect2D getScissors() const;
 
 	vk::Pipeline getPipeline() const;
+	// Compact pipelines take the mesh's Dequantization as vertex push constants.
+	VertexFormat getVertexFormat() const;
 
 	vk::RenderPass getRenderPass() const;
 	vk::PipelineLayout getLayout() const;
@@ -0,0 +1,118 @@
+#include "pipelinecache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// The VkPipelineCacheHeaderVersionOne fields every cache blob starts with.
+struct PipelineCacheHeader {
+	uint32_t headerSize;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+static std::vector<char> readCacheFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		return {};
+	}
+	std::vector<char> data((size_t)file.tellg());
+	file.seekg(0);
+	file.read(data.data(), data.size());
+	if (!file) {
+		return {};
+	}
+	return data;
+}
+
+PipelineCache::PipelineCache(const VulkanContext& vkCtx, std::string path) :
+	_vkCtx(vkCtx),
+	_path(std::move(path))
+{
+	std::vector<char> data;
+	if (!_path.empty()) {
+		data = readCacheFile(_path);
+		if (!data.empty() && !isCompatible(data)) {
+			std::cerr << "pipeline cache: ignoring " << _path << ", it was written for another device or driver" << std::endl;
+			data.clear();
+		}
+	}
+
+	_cache = _vkCtx.getDevice().createPipelineCache(vk::PipelineCacheCreateInfo()
+		.setInitialDataSize(data.size())
+		.setPInitialData(data.data()));
+	_stats.loadedBytes = data.size();
+	_savedSize = data.size();
+}
+
+PipelineCache::~PipelineCache()
+{
+	save();
+	_vkCtx.deviceDestroy(_cache);
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data) const
+{
+	PipelineCacheHeader header;
+	if (data.size() < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+
+	vk::PhysicalDeviceProperties properties = _vkCtx.getPhysicalDevice().getProperties();
+	return header.headerSize >= sizeof(header)
+		&& header.headerSize <= data.size()
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == properties.vendorID
+		&& header.deviceID == properties.deviceID
+		&& memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+vk::PipelineCache PipelineCache::getCache() const
+{
+	return _cache;
+}
+
+void PipelineCache::save()
+{
+	if (_path.empty()) {
+		return;
+	}
+	std::vector<uint8_t> data = _vkCtx.getDevice().getPipelineCacheData(_cache);
+	if (data.empty() || data.size() == _savedSize) {
+		return;
+	}
+
+	// A failed save only costs the next launch its warm start, so report and carry on.
+	std::string tempName = _path + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		file.write((const char*)data.data(), data.size());
+		if (!file) {
+			std::cerr << "pipeline cache: failed to write " << tempName << std::endl;
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempName, _path, error);
+	if (error) {
+		std::cerr << "pipeline cache: failed to replace " << _path << ": " << error.message() << std::endl;
+		return;
+	}
+	_savedSize = data.size();
+}
+
+void PipelineCache::recordCreation(std::chrono::duration<double, std::milli> duration)
+{
+	_stats.pipelines++;
+	_stats.creationMs += duration.count();
+}
+
+const PipelineCacheStats& PipelineCache::getStats() const
+{
+	return _stats;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "vulkancontext.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+constexpr const char* defaultPipelineCachePath = "pipelines.cache";
+
+struct PipelineCacheStats {
+	// Bytes accepted from the cache file, or 0 when it was missing or rejected.
+	size_t loadedBytes = 0;
+	uint32_t pipelines = 0;
+	// Total time spent in pipeline creation calls.
+	double creationMs = 0;
+};
+
+// A driver pipeline cache persisted between runs. The file is only used when its
+// header names this device's vendor, device and pipeline cache UUID, as drivers are
+// not required to reject foreign data themselves. Saves replace the file atomically
+// and are skipped while the driver's data has not changed size since the last one.
+// An empty path keeps the cache in memory only.
+class PipelineCache
+{
+	const VulkanContext& _vkCtx;
+	const std::string _path;
+	vk::PipelineCache _cache;
+	size_t _savedSize = 0;
+	PipelineCacheStats _stats;
+
+	bool isCompatible(const std::vector<char>& data) const;
+public:
+	PipelineCache(const VulkanContext& vkCtx, std::string path = defaultPipelineCachePath);
+	PipelineCache(const PipelineCache&) = delete;
+	// Saves before destroying the cache.
+	~PipelineCache();
+
+	vk::PipelineCache getCache() const;
+	void save();
+
+	// Adds one pipeline creation of the given duration to the stats.
+	void recordCreation(std::chrono::duration<double, std::milli> duration);
+	const PipelineCacheStats& getStats() const;
+};
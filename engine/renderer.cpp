@@ -1,19 +1,62 @@
 #include "renderer.h"
 
+#include "cpuprofiler.h"
 #include "gamestate.h"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <SDL2/SDL_vulkan.h>
+
+#include <algorithm>
 #include <array>
+#include <iostream>
+
+static constexpr size_t uniformBatchSize = 4096;
+
+static vk::Extent2D getDrawableExtent(SDL_Window* window)
+{
+	int width, height;
+	SDL_Vulkan_GetDrawableSize(window, &width, &height);
+	return vk::Extent2D((uint32_t)width, (uint32_t)height);
+}
 
-Renderer::Renderer(const VulkanContext& vkCtx, SDL_Window* window) : _vkCtx(vkCtx),
+Renderer::Renderer(const VulkanContext& vkCtx, JobSystem& jobs, SDL_Window* window, size_t stagingSize, VertexFormat vertexFormat, const std::string& pipelineCachePath) : _vkCtx(vkCtx),
+_jobs(jobs),
 _surface(vkCtx.createSurfaceFromWindow(window)),
-_swapchain(vkCtx, _surface, 800, 600),
-_depthStencil(vkCtx, 800, 600),
-_uniform(vkCtx, _swapchain.getImageCount()),
-_pipeline(vkCtx, _swapchain, _depthStencil.getImageView(), _uniform),
-_transferHandler(vkCtx)
+_swapchain(std::in_place, vkCtx, _surface, getDrawableExtent(window).width, getDrawableExtent(window).height),
+_offscreenTarget(std::in_place, vkCtx, _swapchain->getWidth(), _swapchain->getHeight(), maxFramesInFlight, _swapchain->getFormat().format),
+_depthStencil(vkCtx, _swapchain->getWidth(), _swapchain->getHeight()),
+_uniform(vkCtx, _swapchain->getImageCount()),
+_pipelineCache(vkCtx, pipelineCachePath),
+_pipeline(vkCtx, *_offscreenTarget, _depthStencil.getImageView(), _uniform, _pipelineCache, vertexFormat),
+_geometry(vkCtx, vertexFormat),
+_transferHandler(vkCtx, stagingSize),
+_gpuProfiler(vkCtx, maxFramesInFlight, { vkCtx.getQueueFamilies().graphicsInd.value(), vkCtx.getQueueFamilies().computeInd.value() }),
+_recordThreads(jobs.getWorkerCount() + 1)
+{
+	createFrameResources();
+	_pipelineCache.save();
+}
+
+Renderer::Renderer(const VulkanContext& vkCtx, JobSystem& jobs, uint32_t width, uint32_t height, size_t stagingSize, VertexFormat vertexFormat, const std::string& pipelineCachePath) : _vkCtx(vkCtx),
+_jobs(jobs),
+_offscreenTarget(std::in_place, vkCtx, width, height, maxFramesInFlight),
+_depthStencil(vkCtx, width, height),
+_uniform(vkCtx, maxFramesInFlight),
+_pipelineCache(vkCtx, pipelineCachePath),
+_pipeline(vkCtx, *_offscreenTarget, _depthStencil.getImageView(), _uniform, _pipelineCache, vertexFormat),
+_geometry(vkCtx, vertexFormat),
+_transferHandler(vkCtx, stagingSize),
+_gpuProfiler(vkCtx, maxFramesInFlight, { vkCtx.getQueueFamilies().graphicsInd.value(), vkCtx.getQueueFamilies().computeInd.value() }),
+_recordThreads(jobs.getWorkerCount() + 1)
+{
+	createFrameResources();
+	_pipelineCache.save();
+}
+
+void Renderer::createFrameResources()
 {
 	vk::SemaphoreCreateInfo semaphoreInfo;
 	auto fenceInfo = vk::FenceCreateInfo()
@@ -24,102 +67,519 @@ _transferHandler(vkCtx)
 	_inFlightFences.resize(maxFramesInFlight);
 
 	for (int i = 0; i < _imageAvailableSemaphores.size(); i++) {
-		_imageAvailableSemaphores[i] = vkCtx.getDevice().createSemaphoreUnique(semaphoreInfo);
-		_renderFinishedSemaphores[i] = vkCtx.getDevice().createSemaphoreUnique(semaphoreInfo);
-		_inFlightFences[i] = vkCtx.getDevice().createFenceUnique(fenceInfo);
+		_imageAvailableSemaphores[i] = _vkCtx.getDevice().createSemaphoreUnique(semaphoreInfo);
+		_renderFinishedSemaphores[i] = _vkCtx.getDevice().createSemaphoreUnique(semaphoreInfo);
+		_inFlightFences[i] = _vkCtx.getDevice().createFenceUnique(fenceInfo);
 	}
 
-	uint32_t graphicsQueue = vkCtx.getQueueFamilies().graphicsInd.value();
-	_commandPool = vkCtx.getDevice().createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(graphicsQueue).setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
+	uint32_t graphicsQueue = _vkCtx.getQueueFamilies().graphicsInd.value();
+	_commandPool = _vkCtx.getDevice().createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(graphicsQueue).setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
 
 	auto allocInfo = vk::CommandBufferAllocateInfo()
-		.setCommandBufferCount(_swapchain.getImageCount())
+		.setCommandBufferCount(maxFramesInFlight)
 		.setCommandPool(_commandPool)
 		.setLevel(vk::CommandBufferLevel::ePrimary);
 
-	_commandBuffers = vkCtx.getDevice().allocateCommandBuffers(allocInfo);
+	_commandBuffers = _vkCtx.getDevice().allocateCommandBuffers(allocInfo);
+
+	_recordContexts.resize(maxFramesInFlight * _jobs.getMaxThreadCount());
+	for (auto& context : _recordContexts) {
+		context.pool = _vkCtx.getDevice().createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(graphicsQueue).setFlags(vk::CommandPoolCreateFlagBits::eTransient));
+	}
+
+	vk::PhysicalDevice physicalDevice = _vkCtx.getPhysicalDevice();
+	if (_swapchain) {
+		vk::FormatFeatureFlags features = physicalDevice.getFormatProperties(_offscreenTarget->getFormat()).optimalTilingFeatures;
+		if (!(features & vk::FormatFeatureFlagBits::eBlitSrc) || !(features & vk::FormatFeatureFlagBits::eBlitDst)) {
+			throw std::runtime_error("swapchain format " + vk::to_string(_offscreenTarget->getFormat()) + " does not support blits");
+		}
+		if (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) {
+			_blitFilter = vk::Filter::eLinear;
+		}
+	}
+}
+
+uint32_t Renderer::getImageCount() const
+{
+	return _swapchain ? _swapchain->getImageCount() : _offscreenTarget->getImageCount();
+}
+
+void Renderer::recordBlit(vk::CommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	vk::Image scene = _offscreenTarget->getImages()[_frame];
+	vk::Image target = _swapchain->getImages()[imageIndex];
+	auto range = vk::ImageSubresourceRange()
+		.setAspectMask(vk::ImageAspectFlagBits::eColor)
+		.setBaseMipLevel(0)
+		.setLevelCount(1)
+		.setBaseArrayLayer(0)
+		.setLayerCount(1);
+
+	// The render pass leaves the scene in transfer source layout, and its external
+	// dependency makes that visible to transfer reads. The swapchain image only
+	// needs its transition, chained to the acquire semaphore's transfer stage wait.
+	auto acquire = vk::ImageMemoryBarrier()
+		.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setImage(target)
+		.setSubresourceRange(range);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { acquire });
+
+	auto layers = vk::ImageSubresourceLayers()
+		.setAspectMask(vk::ImageAspectFlagBits::eColor)
+		.setMipLevel(0)
+		.setBaseArrayLayer(0)
+		.setLayerCount(1);
+	vk::Extent2D source = _renderArea.extent;
+	vk::Extent2D output = _swapchain->getScissors().extent;
+	auto blit = vk::ImageBlit()
+		.setSrcSubresource(layers)
+		.setSrcOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D((int32_t)source.width, (int32_t)source.height, 1) })
+		.setDstSubresource(layers)
+		.setDstOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D((int32_t)output.width, (int32_t)output.height, 1) });
+	commandBuffer.blitImage(scene, OffscreenTarget::getFinalLayout(), target, vk::ImageLayout::eTransferDstOptimal, { blit }, _blitFilter);
+
+	auto present = vk::ImageMemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+		.setNewLayout(vk::ImageLayout::ePresentSrcKHR)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setImage(target)
+		.setSubresourceRange(range);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, { present });
 }
 
-void Renderer::bakeModels(const std::vector<Model>& models, std::vector<BakedModel>& bakedModels)
+bool Renderer::isHeadless() const
 {
-	submitModelBake(_vkCtx, _transferHandler, models, bakedModels);
+	return !_swapchain;
 }
 
-void Renderer::drawFrame(GraphicsGameState& gameState, std::mutex& mutex)
+size_t Renderer::getMaxRecordThreads() const
 {
-	_vkCtx.getDevice().waitForFences({ _inFlightFences[_frame].get() }, true, UINT64_MAX);
-	mutex.lock();
-	unsigned i = 0;
+	return _jobs.getWorkerCount() + 1;
+}
 
+void Renderer::setRecordThreads(size_t threads)
+{
+	_recordThreads = std::clamp<size_t>(threads, 1, getMaxRecordThreads());
+}
 
-	std::chrono::duration<float> dt = std::chrono::high_resolution_clock::now() - gameState.timeStamp;
-	for (const auto& object : gameState.objects) {
-		for (const auto& instance : object.instances) {
-			ModelUniform uniform;
-			uniform.modelTrans = instance.globalTransform;
-			uniform.trans = gameState.sceneMatrix * glm::translate(instance.globalTransform, instance.velocity*dt.count());
-			memcpy((char*)(_uniform.getModelUniforms()[_frame].data) + i * _uniform.getModelUniformSize(), &uniform, sizeof(ModelUniform));
-			i++;
+void Renderer::queueModelUpload(Model&& model, std::function<void(const BakedModel&)> onBaked, std::function<void(std::exception_ptr)> onFailed)
+{
+	if (_geometry.getVertexFormat() == VertexFormat::Compact) {
+		model.quantize();
+	}
+	std::lock_guard<std::mutex> lock(_uploadMutex);
+	_uploads.push_back({ std::move(model), std::move(onBaked), std::move(onFailed) });
+}
+
+bool Renderer::uploadQueuedModels()
+{
+	std::vector<Model> models;
+	PendingBake bake;
+	std::vector<std::function<void(std::exception_ptr)>> failureCallbacks;
+	bool queued;
+	{
+		std::lock_guard<std::mutex> lock(_uploadMutex);
+		size_t batchSize = 0;
+		while (!_uploads.empty()) {
+			const Model& model = _uploads.front().model;
+			size_t size = model.getVertexBytes(_geometry.getVertexFormat()).size() + model.indexData.size_bytes();
+			if (!models.empty() && batchSize + size > _transferHandler.getSize()) {
+				break;
+			}
+			batchSize += size;
+			models.push_back(std::move(_uploads.front().model));
+			bake.callbacks.push_back(std::move(_uploads.front().onBaked));
+			failureCallbacks.push_back(std::move(_uploads.front().onFailed));
+			_uploads.pop_front();
+		}
+		queued = !_uploads.empty();
+	}
+
+	if (!models.empty()) {
+		bake.models.resize(models.size());
+		try {
+			bake.token = submitModelBake(_geometry, _transferHandler, models, bake.models);
+			_pendingBakes.push_back(std::move(bake));
+		}
+		catch (const std::runtime_error&) {
+			// This runs on the render thread; the error goes to whoever queued the models.
+			for (const auto& onFailed : failureCallbacks) {
+				onFailed(std::current_exception());
+			}
+		}
+	}
+
+	bool timeline = (bool)_transferHandler.getTimeline();
+	while (!_pendingBakes.empty() && (timeline || _transferHandler.isComplete(_pendingBakes.front().token))) {
+		PendingBake& pending = _pendingBakes.front();
+		for (size_t i = 0; i < pending.models.size(); i++) {
+			pending.callbacks[i](pending.models[i]);
+		}
+		if (timeline) {
+			_uploadWaitValue = pending.token;
+		}
+		_pendingBakes.pop_front();
+	}
+	return queued || !_pendingBakes.empty();
+}
+
+void Renderer::releaseModel(const BakedModel& model)
+{
+	_geometry.free(model.geometry);
+}
+
+void Renderer::flushUploads()
+{
+	while (uploadQueuedModels()) {
+		if (!_pendingBakes.empty()) {
+			_transferHandler.wait(_pendingBakes.back().token);
+		}
+	}
+}
+
+vk::CommandBuffer Renderer::recordObjects(size_t begin, size_t end, size_t worker, uint32_t& drawCalls)
+{
+	PROFILE_ZONE("Renderer::recordObjects");
+	auto& context = _recordContexts[_frame * _jobs.getMaxThreadCount() + worker];
+	if (context.used == context.commandBuffers.size()) {
+		auto allocInfo = vk::CommandBufferAllocateInfo()
+			.setCommandBufferCount(1)
+			.setCommandPool(context.pool)
+			.setLevel(vk::CommandBufferLevel::eSecondary);
+		context.commandBuffers.push_back(_vkCtx.getDevice().allocateCommandBuffers(allocInfo)[0]);
+	}
+	vk::CommandBuffer commandBuffer = context.commandBuffers[context.used++];
+
+	auto inheritanceInfo = vk::CommandBufferInheritanceInfo()
+		.setRenderPass(_pipeline.getRenderPass())
+		.setSubpass(0)
+		.setFramebuffer(_pipeline.getFramebuffers()[_frame]);
+
+	auto beginInfo = vk::CommandBufferBeginInfo()
+		.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+		.setPInheritanceInfo(&inheritanceInfo);
+
+	commandBuffer.begin(beginInfo);
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline.getPipeline());
+	auto viewport = vk::Viewport()
+		.setX(0)
+		.setY(0)
+		.setWidth((float)_renderArea.extent.width)
+		.setHeight((float)_renderArea.extent.height)
+		.setMinDepth(0)
+		.setMaxDepth(1.0);
+	commandBuffer.setViewport(0, { viewport });
+	commandBuffer.setScissor(0, { _renderArea });
+	vk::DescriptorSet modelDescriptor = _gpuCuller ? _gpuCuller->getModelDescriptor(_frame) : _uniform.getModelUniforms()[_frame].descriptor;
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline.getLayout(), 0, { _uniform.getSceneUniforms()[_frame].descriptor, modelDescriptor }, { });
+	_geometry.bind(commandBuffer);
+	bool compact = _pipeline.getVertexFormat() == VertexFormat::Compact;
+	vk::IndexType boundIndexType = vk::IndexType::eUint16;
+	for (size_t k = begin; k < end; k++) {
+		const auto& object = _drawObjects[k];
+		if (object.instanceCount == 0 || !object.model.isReady()) {
+			continue;
+		}
+		if (object.model.geometry.indexType != boundIndexType) {
+			boundIndexType = object.model.geometry.indexType;
+			_geometry.bindIndices(commandBuffer, boundIndexType);
+		}
+		if (compact) {
+			commandBuffer.pushConstants(_pipeline.getLayout(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(Dequantization), &object.model.dequantization);
+		}
+		if (_gpuCuller) {
+			_gpuCuller->drawObject(commandBuffer, _frame, object.object);
+		}
+		else {
+			const MeshLod& lod = object.model.lods[object.lod];
+			commandBuffer.drawIndexed(lod.indexCount, object.instanceCount, lod.firstIndex, (int32_t)object.model.geometry.vertexOffset, object.firstInstance);
+		}
+		drawCalls++;
+	}
+	commandBuffer.end();
+
+	return commandBuffer;
+}
+
+uint32_t Renderer::getLodCount(const BakedModel& model) const
+{
+	return _lodEnabled ? std::max(model.lodCount, 1u) : 1;
+}
+
+uint32_t Renderer::cullOnCpu(const GraphicsGameState& gameState, const glm::mat4& sceneMatrix, const float* frustumPlanes, float alpha, uint32_t& culled, uint64_t& triangles)
+{
+	PROFILE_ZONE("Renderer::cullOnCpu");
+	size_t instanceCount = 0;
+	_instanceRanges.clear();
+	_instanceLods.resize(gameState.objects.size());
+	for (size_t k = 0; k < gameState.objects.size(); k++) {
+		size_t count = gameState.objects[k].model.isReady() ? gameState.objects[k].getInstanceCount() : 0;
+		_instanceLods[k].resize(gameState.objects[k].getInstanceCount());
+		for (size_t begin = 0; begin < count; begin += uniformBatchSize) {
+			_instanceRanges.push_back({ k, begin, std::min(count, begin + uniformBatchSize), instanceCount + begin });
 		}
+		instanceCount += count;
 	}
-	mutex.unlock();
+	_visibleInstances.resize(instanceCount);
+	_lodInstances.resize(instanceCount);
+
+	const float* scene = glm::value_ptr(sceneMatrix);
+	_jobs.wait(_jobs.parallelFor(_instanceRanges.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++) {
+			auto& range = _instanceRanges[r];
+			const auto& object = gameState.objects[range.object];
+			uint32_t* visible = _visibleInstances.data() + range.visibleOffset;
+			range.visibleCount = cullInstances(frustumPlanes, object.model.bounds.getOriginRadius(), object.previous, object.current, alpha,
+				range.begin, range.end, visible);
+
+			uint32_t lodCount = getLodCount(object.model);
+			uint8_t* lods = _instanceLods[range.object].data();
+			if (lodCount > 1) {
+				selectLods(scene, object.model.bounds.radius, lodScreenSizes, lodCount, lodHysteresis, object.previous, object.current, alpha,
+					visible, range.visibleCount, lods);
+			}
+			else {
+				for (size_t n = 0; n < range.visibleCount; n++) {
+					lods[visible[n]] = 0;
+				}
+			}
+
+			// Group the visible instances by level, keeping each group in ascending order.
+			range.lodCounts.fill(0);
+			for (size_t n = 0; n < range.visibleCount; n++) {
+				range.lodCounts[lods[visible[n]]]++;
+			}
+			std::array<uint32_t, maxMeshLods> offsets;
+			uint32_t offset = 0;
+			for (uint32_t l = 0; l < maxMeshLods; l++) {
+				offsets[l] = offset;
+				offset += range.lodCounts[l];
+			}
+			uint32_t* grouped = _lodInstances.data() + range.visibleOffset;
+			for (size_t n = 0; n < range.visibleCount; n++) {
+				grouped[offsets[lods[visible[n]]]++] = visible[n];
+			}
+		}
+	}));
+
+	// Each level of an object draws its instances from every range of that object.
+	uint32_t i = 0;
+	triangles = 0;
+	_drawObjects.clear();
+	size_t rangeEnd = 0;
+	for (size_t k = 0; k < gameState.objects.size(); k++) {
+		const BakedModel& model = gameState.objects[k].model;
+		size_t rangeBegin = rangeEnd;
+		while (rangeEnd < _instanceRanges.size() && _instanceRanges[rangeEnd].object == k) {
+			rangeEnd++;
+		}
+		for (uint32_t l = 0; l < getLodCount(model); l++) {
+			DrawObject drawObject = { model, k, l, i, 0 };
+			for (size_t r = rangeBegin; r < rangeEnd; r++) {
+				auto& range = _instanceRanges[r];
+				range.lodFirstInstances[l] = i;
+				drawObject.instanceCount += range.lodCounts[l];
+				i += range.lodCounts[l];
+			}
+			if (drawObject.instanceCount > 0) {
+				triangles += (uint64_t)drawObject.instanceCount * (model.lods[l].indexCount / 3);
+				_drawObjects.push_back(drawObject);
+			}
+		}
+	}
+
+	_uniform.reserveModelUniforms((int)_frame, i);
+	ModelUniform* uniformData = (ModelUniform*)_uniform.getModelUniforms()[_frame].data;
+	_jobs.wait(_jobs.parallelFor(_instanceRanges.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++) {
+			const auto& range = _instanceRanges[r];
+			const auto& object = gameState.objects[range.object];
+			const uint32_t* grouped = _lodInstances.data() + range.visibleOffset;
+			for (uint32_t l = 0; l < maxMeshLods; l++) {
+				if (range.lodCounts[l] > 0) {
+					writeModelUniforms(scene, object.previous, object.current, alpha,
+						grouped, range.lodCounts[l], (float*)(uniformData + range.lodFirstInstances[l]));
+				}
+				grouped += range.lodCounts[l];
+			}
+		}
+	}));
 	vmaFlushAllocation(_vkCtx.getAllocator(), _uniform.getModelUniforms()[_frame].buffer.allocation, 0, VK_WHOLE_SIZE);
 
+	culled = (uint32_t)instanceCount - i;
+	return i;
+}
+
+void Renderer::drawFrame(const GraphicsGameState& gameState)
+{
+	PROFILE_ZONE("Renderer::drawFrame");
+	{
+		PROFILE_ZONE("wait for frame");
+		_vkCtx.getDevice().waitForFences({ _inFlightFences[_frame].get() }, true, UINT64_MAX);
+	}
+	float gpuTime = 0.0f;
+	if (_gpuProfiler.beginFrame(_frame)) {
+		gpuTime = _gpuProfiler.getTiming("frame")->lastMs;
+	}
+	if (_dynamicResolution && gpuTime > 0.0f) {
+		_dynamicResolution->update(gpuTime);
+	}
+	vk::Extent2D outputExtent = _offscreenTarget->getScissors().extent;
+	_renderArea = vk::Rect2D({ 0, 0 }, _dynamicResolution ? _dynamicResolution->getExtent(outputExtent) : outputExtent);
+	uploadQueuedModels();
+	auto cpuStart = std::chrono::high_resolution_clock::now();
+
+	float alpha = gameState.getInterpolation(std::chrono::high_resolution_clock::now());
+	// The render area is scaled uniformly and stretched back to the output, so the
+	// output decides the aspect.
+	float aspect = (float)outputExtent.width / (float)outputExtent.height;
+	glm::mat4 sceneMatrix = getSceneMatrix(interpolate(gameState.previousCamera, gameState.camera, alpha), aspect);
+	float frustumPlanes[24];
+	extractFrustumPlanes(glm::value_ptr(sceneMatrix), frustumPlanes);
+
+	uint32_t visibleCount = 0;
+	uint32_t culledCount = 0;
+	uint64_t triangles = 0;
+	vk::Semaphore cullFinished;
+	if (_gpuCuller) {
+		// Counts come from the last frame that used this slot.
+		visibleCount = _gpuCuller->collect(_frame, culledCount, triangles);
+		_gpuCuller->prepare(_frame, gameState, sceneMatrix, frustumPlanes, alpha, _lodEnabled ? (uint32_t)maxMeshLods : 1);
+		cullFinished = _gpuCuller->submit(_frame, _gpuProfiler);
+
+		uint32_t firstInstance = 0;
+		_drawObjects.resize(gameState.objects.size());
+		for (size_t k = 0; k < gameState.objects.size(); k++) {
+			uint32_t count = (uint32_t)gameState.objects[k].getInstanceCount();
+			_drawObjects[k] = { gameState.objects[k].model, k, 0, firstInstance, count };
+			firstInstance += count;
+		}
+	}
+	else {
+		visibleCount = cullOnCpu(gameState, sceneMatrix, frustumPlanes, alpha, culledCount, triangles);
+	}
 
 	_vkCtx.getDevice().resetFences({ _inFlightFences[_frame].get() });
 	vk::Queue queue = _vkCtx.getGraphicsQueue(0);
-	uint32_t imageIndex = _swapchain.acquireNextImage(_imageAvailableSemaphores[_frame].get());
+	uint32_t imageIndex = (uint32_t)_frame;
+	if (_swapchain) {
+		PROFILE_ZONE("acquire image");
+		imageIndex = _swapchain->acquireNextImage(_imageAvailableSemaphores[_frame].get());
+	}
 
-	const vk::CommandBuffer& commandBuffer = _commandBuffers[imageIndex];
+	for (size_t worker = 0; worker < _jobs.getMaxThreadCount(); worker++) {
+		auto& context = _recordContexts[_frame * _jobs.getMaxThreadCount() + worker];
+		_vkCtx.getDevice().resetCommandPool(context.pool, {});
+		context.used = 0;
+	}
+
+	size_t sliceCount = std::min(_recordThreads, _drawObjects.size());
+	std::vector<vk::CommandBuffer> secondaryBuffers(sliceCount);
+	std::vector<uint32_t> drawCalls(sliceCount);
+	_jobs.wait(_jobs.parallelFor(sliceCount, 1, [&](size_t sliceBegin, size_t sliceEnd) {
+		for (size_t slice = sliceBegin; slice < sliceEnd; slice++) {
+			size_t begin = _drawObjects.size() * slice / sliceCount;
+			size_t end = _drawObjects.size() * (slice + 1) / sliceCount;
+			secondaryBuffers[slice] = recordObjects(begin, end, _jobs.getThreadIndex(), drawCalls[slice]);
+		}
+	}));
+
+	const vk::CommandBuffer& commandBuffer = _commandBuffers[_frame];
 	auto clearColor = vk::ClearValue().setColor(vk::ClearColorValue().setFloat32({ 0, 0, 0, 1.0 }));
 	auto clearDepth = vk::ClearValue().setColor(vk::ClearColorValue().setFloat32({ 1.0, 0, 0, 0 }));
 
 	vk::ClearValue clearValues[] = { clearColor, clearDepth };
 
-	auto renderArea = vk::Rect2D();
-
 	auto beginInfo = vk::CommandBufferBeginInfo();
 
 	auto renderPassBeginInfo = vk::RenderPassBeginInfo()
 		.setClearValueCount(2)
 		.setPClearValues(clearValues)
-		.setFramebuffer(_pipeline.getFramebuffers()[imageIndex])
-		.setRenderArea(_pipeline.getScissors())
+		.setFramebuffer(_pipeline.getFramebuffers()[_frame])
+		.setRenderArea(_renderArea)
 		.setRenderPass(_pipeline.getRenderPass());
 	commandBuffer.reset({});
 	commandBuffer.begin(beginInfo);
-	commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline.getPipeline());
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline.getLayout(), 0, { _uniform.getSceneUniforms()[_frame].descriptor }, { });
-	i = 0;
-	for (const auto& object : gameState.objects) {
-		vk::DeviceSize offset{};
-		commandBuffer.bindVertexBuffers(0, 1, &object.model.vertices.data, &offset);
-		commandBuffer.bindIndexBuffer(object.model.indices.data, 0, vk::IndexType::eUint16);
-		for (const auto& model : object.instances) {
-			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline.getLayout(), 1, { _uniform.getModelUniforms()[_frame].descriptor }, { i * (unsigned)_uniform.getModelUniformSize() });
-			commandBuffer.drawIndexed((uint32_t)object.model.indices.size, 1, 0, 0, 0);
-			i++;
-		}
+	GpuRegion frameRegion = _gpuProfiler.beginRegion(commandBuffer, "frame");
+	GpuRegion sceneRegion = _gpuProfiler.beginRegion(commandBuffer, "scene");
+	commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+	if (!secondaryBuffers.empty()) {
+		commandBuffer.executeCommands(secondaryBuffers);
 	}
 	commandBuffer.endRenderPass();
+	_gpuProfiler.endRegion(commandBuffer, sceneRegion);
+	if (_swapchain) {
+		GpuRegion blitRegion = _gpuProfiler.beginRegion(commandBuffer, "blit");
+		recordBlit(commandBuffer, imageIndex);
+		_gpuProfiler.endRegion(commandBuffer, blitRegion);
+	}
+	_gpuProfiler.endRegion(commandBuffer, frameRegion);
 	commandBuffer.end();
 
-	vk::Semaphore waitSemaphores[] = { _imageAvailableSemaphores[_frame].get() };
+	_stats = FrameStats();
+	_stats.instances = visibleCount;
+	_stats.culledInstances = culledCount;
+	_stats.triangles = triangles;
+	_stats.gpuTime = gpuTime;
+	_stats.resolutionScale = _dynamicResolution ? _dynamicResolution->getScale() : 1.0f;
+	for (uint32_t sliceDrawCalls : drawCalls) {
+		_stats.drawCalls += sliceDrawCalls;
+	}
+
+	std::vector<vk::Semaphore> waitSemaphores;
+	std::vector<vk::PipelineStageFlags> waitStages;
+	if (_swapchain) {
+		// The swapchain image is first touched by the blit.
+		waitSemaphores.push_back(_imageAvailableSemaphores[_frame].get());
+		waitStages.push_back(vk::PipelineStageFlagBits::eTransfer);
+	}
+	if (cullFinished) {
+		waitSemaphores.push_back(cullFinished);
+		waitStages.push_back(_gpuCuller->getWaitStages());
+	}
+	// Binary semaphores ignore their entry in the value array.
+	std::vector<uint64_t> waitValues(waitSemaphores.size());
+	if (_uploadWaitValue > 0) {
+		waitSemaphores.push_back(_transferHandler.getTimeline());
+		waitStages.push_back(vk::PipelineStageFlagBits::eVertexInput);
+		waitValues.push_back(_uploadWaitValue);
+	}
 	vk::Semaphore signalSemaphores[] = { _renderFinishedSemaphores[_frame].get() };
-	vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
 	auto submitInfo = vk::SubmitInfo()
-		.setWaitSemaphoreCount(1)
-		.setPWaitSemaphores(waitSemaphores)
-		.setPWaitDstStageMask(waitStages)
 		.setCommandBufferCount(1)
 		.setPCommandBuffers(&commandBuffer)
+		.setWaitSemaphoreCount((uint32_t)waitSemaphores.size())
+		.setPWaitSemaphores(waitSemaphores.data())
+		.setPWaitDstStageMask(waitStages.data());
+	auto timelineInfo = vk::TimelineSemaphoreSubmitInfo()
+		.setWaitSemaphoreValueCount((uint32_t)waitValues.size())
+		.setPWaitSemaphoreValues(waitValues.data());
+	if (_uploadWaitValue > 0) {
+		submitInfo.setPNext(&timelineInfo);
+	}
+
+	std::chrono::duration<float, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - cpuStart;
+	_stats.cpuTime = cpuTime.count();
+
+	if (!_swapchain) {
+		queue.submit({ submitInfo }, _inFlightFences[_frame].get());
+		_frame = (_frame + 1) % maxFramesInFlight;
+		return;
+	}
+
+	submitInfo
 		.setSignalSemaphoreCount(1)
 		.setPSignalSemaphores(signalSemaphores);
 
 	queue.submit({ submitInfo }, _inFlightFences[_frame].get());
 
-	vk::SwapchainKHR swapchains[] = { _swapchain.getSwapchain() };
+	vk::SwapchainKHR swapchains[] = { _swapchain->getSwapchain() };
 
 	auto presentInfo = vk::PresentInfoKHR()
 		.setSwapchainCount(1)
@@ -128,12 +588,80 @@ void Renderer::drawFrame(GraphicsGameState& gameState, std::mutex& mutex)
 		.setWaitSemaphoreCount(1)
 		.setPWaitSemaphores(signalSemaphores);
 
-	queue.presentKHR(&presentInfo);
+	{
+		PROFILE_ZONE("present");
+		queue.presentKHR(&presentInfo);
+	}
 
 	_frame = (_frame + 1) % maxFramesInFlight;
 }
 
-Renderer::~Renderer()
+void Renderer::setCullMode(CullMode mode)
 {
+	if (mode == getCullMode()) {
+		return;
+	}
+	if (mode != CullMode::Cpu && !_vkCtx.supportsDrawIndirectFirstInstance()) {
+		throw std::runtime_error("GPU culling needs the drawIndirectFirstInstance feature");
+	}
+	_vkCtx.getDevice().waitIdle();
+	_gpuCuller.reset();
+	if (mode != CullMode::Cpu) {
+		_gpuCuller.emplace(_vkCtx, _jobs, _pipelineCache, _uniform.getModelLayout(), maxFramesInFlight, mode == CullMode::GpuVerify);
+		// Persist the new pipeline now rather than only at shutdown.
+		_pipelineCache.save();
+	}
+	_cullMode = mode;
+}
 
+CullMode Renderer::getCullMode() const
+{
+	return _cullMode;
+}
+
+void Renderer::setLodEnabled(bool enabled)
+{
+	_lodEnabled = enabled;
+}
+
+void Renderer::setDynamicResolution(float budgetMs, float minScale)
+{
+	_dynamicResolution.reset();
+	if (budgetMs <= 0.0f) {
+		return;
+	}
+	if (!_gpuProfiler.isSupported()) {
+		std::cerr << "dynamic resolution: no GPU timestamps, rendering at full resolution" << std::endl;
+		return;
+	}
+	_dynamicResolution.emplace(budgetMs, minScale);
+}
+
+const CullVerification* Renderer::getCullVerification() const
+{
+	return _gpuCuller ? &_gpuCuller->getVerification() : nullptr;
+}
+
+const PipelineCacheStats& Renderer::getPipelineCacheStats() const
+{
+	return _pipelineCache.getStats();
+}
+
+const GpuProfiler& Renderer::getGpuProfiler() const
+{
+	return _gpuProfiler;
+}
+
+const FrameStats& Renderer::getFrameStats() const
+{
+	return _stats;
+}
+
+Renderer::~Renderer()
+{
+	_transferHandler.wait(_transferHandler.submit());
+	for (auto& context : _recordContexts) {
+		_vkCtx.deviceDestroy(context.pool);
+	}
+	_vkCtx.deviceDestroy(_commandPool);
 }
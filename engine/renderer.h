@@ -2,25 +2,104 @@
 
 #include "asynctransferhandler.h"
 #include "defaultuniform.h"
+#include "geometrypool.h"
 #include "depthstencil.h"
+#include "dynamicresolution.h"
+#include "gpuculler.h"
+#include "gpuprofiler.h"
+#include "jobsystem.h"
 #include "model.h"
+#include "offscreentarget.h"
 #include "pipeline.h"
+#include "pipelinecache.h"
 
+#include <array>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <mutex>
+#include <optional>
 
 struct GraphicsGameState;
 
 constexpr int maxFramesInFlight = 2;
 
+struct FrameStats {
+	uint32_t drawCalls = 0;
+	uint32_t instances = 0;
+	uint32_t culledInstances = 0;
+	uint64_t triangles = 0;
+	float cpuTime = 0;
+	// GPU time of the last frame that finished in this frame's slot, or 0 when it
+	// was not measured.
+	float gpuTime = 0;
+	// Fraction of the output resolution the frame was rendered at.
+	float resolutionScale = 1;
+};
+
+// One level of detail of an object with CPU culling, or a whole object with GPU
+// culling, where the culler's commands pick the levels.
+struct DrawObject {
+	BakedModel model;
+	size_t object;
+	uint32_t lod;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+struct InstanceRange {
+	size_t object;
+	size_t begin;
+	size_t end;
+	size_t visibleOffset;
+	size_t visibleCount;
+	// Visible instances of each level, grouped in that order from visibleOffset.
+	std::array<uint32_t, maxMeshLods> lodCounts;
+	std::array<uint32_t, maxMeshLods> lodFirstInstances;
+};
+
+struct ModelUpload {
+	Model model;
+	std::function<void(const BakedModel&)> onBaked;
+	std::function<void(std::exception_ptr)> onFailed;
+};
+
+struct PendingBake {
+	TransferToken token;
+	std::vector<BakedModel> models;
+	std::vector<std::function<void(const BakedModel&)>> callbacks;
+};
+
+struct RecordContext {
+	vk::CommandPool pool;
+	std::vector<vk::CommandBuffer> commandBuffers;
+	size_t used = 0;
+};
+
 class Renderer
 {
 	const VulkanContext& _vkCtx;
+	JobSystem& _jobs;
 	vk::SurfaceKHR _surface;
-	Swapchain _swapchain;
+	std::optional<Swapchain> _swapchain;
+	// The scene is rendered here, one image per frame in flight, and blitted to the
+	// swapchain when there is one.
+	std::optional<OffscreenTarget> _offscreenTarget;
 	DepthStencil _depthStencil;
 	DefaultUniformLayout _uniform;
+	PipelineCache _pipelineCache;
 	Pipeline _pipeline;
+	GeometryPool _geometry;
 	AsyncTransferHandler _transferHandler;
+	GpuProfiler _gpuProfiler;
+	CullMode _cullMode = CullMode::Cpu;
+	std::optional<GpuCuller> _gpuCuller;
+
+	std::mutex _uploadMutex;
+	std::deque<ModelUpload> _uploads;
+	std::deque<PendingBake> _pendingBakes;
+	// Upload timeline value every frame waits on before vertex input.
+	TransferToken _uploadWaitValue = 0;
 
 	std::vector<vk::UniqueHandle<vk::Semaphore, vk::DispatchLoaderStatic>> _imageAvailableSemaphores;
 	std::vector<vk::UniqueHandle<vk::Semaphore, vk::DispatchLoaderStatic>> _renderFinishedSemaphores;
@@ -28,14 +107,68 @@ class Renderer
 
 	vk::CommandPool _commandPool;
 	std::vector<vk::CommandBuffer> _commandBuffers;
+	std::vector<RecordContext> _recordContexts;
+	std::vector<DrawObject> _drawObjects;
+	std::vector<InstanceRange> _instanceRanges;
+	std::vector<uint32_t> _visibleInstances;
+	std::vector<uint32_t> _lodInstances;
+	// Level of detail each instance was drawn with last frame, per object.
+	std::vector<std::vector<uint8_t>> _instanceLods;
+	bool _lodEnabled = true;
+	std::optional<DynamicResolution> _dynamicResolution;
+	// Part of the offscreen target the current frame renders to.
+	vk::Rect2D _renderArea;
+	vk::Filter _blitFilter = vk::Filter::eNearest;
+	size_t _recordThreads;
 	size_t _frame = 0;
+	FrameStats _stats;
 
+	void createFrameResources();
+	uint32_t getImageCount() const;
+	void recordBlit(vk::CommandBuffer commandBuffer, uint32_t imageIndex);
+	uint32_t getLodCount(const BakedModel& model) const;
+	uint32_t cullOnCpu(const GraphicsGameState& gameState, const glm::mat4& sceneMatrix, const float* frustumPlanes, float alpha, uint32_t& culled, uint64_t& triangles);
+	vk::CommandBuffer recordObjects(size_t begin, size_t end, size_t worker, uint32_t& drawCalls);
 public:
-	Renderer(const VulkanContext& vkCtx, SDL_Window* window);
+	Renderer(const VulkanContext& vkCtx, JobSystem& jobs, SDL_Window* window, size_t stagingSize = defaultStagingSize, VertexFormat vertexFormat = VertexFormat::Float, const std::string& pipelineCachePath = defaultPipelineCachePath);
+	Renderer(const VulkanContext& vkCtx, JobSystem& jobs, uint32_t width, uint32_t height, size_t stagingSize = defaultStagingSize, VertexFormat vertexFormat = VertexFormat::Float, const std::string& pipelineCachePath = defaultPipelineCachePath);
+
+	bool isHeadless() const;
+	size_t getMaxRecordThreads() const;
+	void setRecordThreads(size_t threads);
+	void setCullMode(CullMode mode);
+	CullMode getCullMode() const;
+	// With levels of detail disabled every instance is drawn at full detail.
+	void setLodEnabled(bool enabled);
+	// Scales the rendered resolution every frame to keep GPU time within budgetMs,
+	// down to minScale of the output on each axis. A budget of 0 renders at full
+	// resolution. Needs GPU timestamps; without them the scale stays at 1.
+	void setDynamicResolution(float budgetMs, float minScale = defaultMinResolutionScale);
+	const CullVerification* getCullVerification() const;
+	// Regions timed: "frame" covers the graphics command buffer, "scene" its render
+	// pass and "blit" the copy to the swapchain; "cull" and "place" are the GPU cull
+	// passes.
+	const GpuProfiler& getGpuProfiler() const;
+	const PipelineCacheStats& getPipelineCacheStats() const;
 
-	void bakeModels(const std::vector<Model>& models, std::vector<BakedModel>& bakedModels);
+	// Thread safe. The model is uploaded by a later uploadQueuedModels call, which
+	// then hands the baked model to onBaked, or the error to onFailed when the
+	// geometry pool is out of space. Models bound for a compact pool are quantized
+	// here, on the calling thread.
+	void queueModelUpload(Model&& model, std::function<void(const BakedModel&)> onBaked, std::function<void(std::exception_ptr)> onFailed);
+	// Stages up to one staging ring's worth of queued models without waiting for the
+	// copies, then hands models to their callbacks. With timeline semaphores that
+	// happens right after submission and the next frame waits for the upload on the
+	// GPU; otherwise once the upload's fence has signaled. drawFrame calls this every
+	// frame. Returns false once nothing is queued or in flight.
+	bool uploadQueuedModels();
+	// Uploads everything queued and waits for it to finish.
+	void flushUploads();
+	// Returns the model's geometry to the pool. The GPU must be done with it.
+	void releaseModel(const BakedModel& model);
 
 	Renderer(const Renderer&) = delete;
-	void drawFrame(GraphicsGameState& gameState, std::mutex& mutex);
+	void drawFrame(const GraphicsGameState& gameState);
+	const FrameStats& getFrameStats() const;
 	~Renderer();
 };
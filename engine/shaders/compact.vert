@@ -0,0 +1,38 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec4 normal;
+
+// Unorm position within the mesh bounds, w is zero.
+layout(location = 0) in vec4 inPosition;
+// Octahedral normal.
+layout(location = 1) in vec2 inNormal;
+
+struct ModelUniform {
+    mat4 trans;
+    mat4 modelTrans;
+};
+
+layout(std430, set=1, binding = 0) readonly buffer ModelBuffer {
+    ModelUniform instances[];
+} model;
+
+layout(push_constant) uniform Dequantization {
+    vec4 scale;
+    vec4 offset;
+} dequant;
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+void main() {
+    ModelUniform instance = model.instances[gl_InstanceIndex];
+    gl_Position = instance.trans * (dequant.offset + dequant.scale * inPosition);
+    vec4 norm = vec4(decodeOctahedral(inNormal), 0);
+    normal = instance.modelTrans * norm;
+}
\ No newline at end of file
@@ -6,14 +6,18 @@ layout(location = 0) out vec4 normal;
 layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec4 inNormal;
 
-
-layout(set=1, binding = 0) uniform UniformBufferObject {
+struct ModelUniform {
     mat4 trans;
     mat4 modelTrans;
+};
+
+layout(std430, set=1, binding = 0) readonly buffer ModelBuffer {
+    ModelUniform instances[];
 } model;
 
 void main() {
-    gl_Position = model.trans * inPosition;
+    ModelUniform instance = model.instances[gl_InstanceIndex];
+    gl_Position = instance.trans * inPosition;
     vec4 norm = vec4(inNormal.xyx, 0);
-    normal = model.modelTrans * norm;
+    normal = instance.modelTrans * norm;
 }
\ No newline at end of file
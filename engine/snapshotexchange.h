@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+
+enum class ExchangeMode {
+	Mailbox,
+	Mutex
+};
+
+struct ExchangeStats {
+	std::atomic<uint64_t> published = 0;
+	std::atomic<uint64_t> dropped = 0;
+	std::atomic<uint64_t> acquired = 0;
+	std::atomic<uint64_t> stale = 0;
+	std::atomic<uint64_t> producerNanoseconds = 0;
+	std::atomic<uint64_t> consumerNanoseconds = 0;
+};
+
+// Latest-value exchange between one producer and one consumer. The producer fills getBack()
+// and publishes it; the consumer acquires the newest published buffer into getFront(). In
+// Mailbox mode both sides are wait-free, Mutex mode does the same swap under a lock so the
+// two can be compared through getStats().
+template<class T>
+class SnapshotExchange
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	static constexpr uint8_t indexMask = 3;
+	static constexpr uint8_t freshBit = 4;
+
+	const ExchangeMode _mode;
+	std::array<T, 3> _buffers;
+	std::atomic<uint8_t> _middle = 1;
+	uint8_t _back = 2;
+	uint8_t _front = 0;
+	std::mutex _mutex;
+	ExchangeStats _stats;
+
+	static uint64_t elapsed(Clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+public:
+	SnapshotExchange(ExchangeMode mode = ExchangeMode::Mailbox) : _mode(mode) {}
+	SnapshotExchange(const SnapshotExchange&) = delete;
+
+	std::array<T, 3>& getBuffers() {
+		return _buffers;
+	}
+
+	T& getBack() {
+		return _buffers[_back];
+	}
+
+	const T& getFront() const {
+		return _buffers[_front];
+	}
+
+	const ExchangeStats& getStats() const {
+		return _stats;
+	}
+
+	void publish() {
+		Clock::time_point start = Clock::now();
+		uint8_t previous;
+		if (_mode == ExchangeMode::Mailbox) {
+			previous = _middle.exchange(_back | freshBit, std::memory_order_acq_rel);
+		}
+		else {
+			std::lock_guard<std::mutex> lock(_mutex);
+			previous = _middle.load(std::memory_order_relaxed);
+			_middle.store(_back | freshBit, std::memory_order_relaxed);
+		}
+		_back = previous & indexMask;
+
+		if (previous & freshBit) {
+			_stats.dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		_stats.published.fetch_add(1, std::memory_order_relaxed);
+		_stats.producerNanoseconds.fetch_add(elapsed(start), std::memory_order_relaxed);
+	}
+
+	bool acquire() {
+		Clock::time_point start = Clock::now();
+		bool fresh;
+		if (_mode == ExchangeMode::Mailbox) {
+			fresh = _middle.load(std::memory_order_relaxed) & freshBit;
+			if (fresh) {
+				_front = _middle.exchange(_front, std::memory_order_acq_rel) & indexMask;
+			}
+		}
+		else {
+			std::lock_guard<std::mutex> lock(_mutex);
+			uint8_t middle = _middle.load(std::memory_order_relaxed);
+			fresh = middle & freshBit;
+			if (fresh) {
+				_middle.store(_front, std::memory_order_relaxed);
+				_front = middle & indexMask;
+			}
+		}
+
+		if (fresh) {
+			_stats.acquired.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			_stats.stale.fetch_add(1, std::memory_order_relaxed);
+		}
+		_stats.consumerNanoseconds.fetch_add(elapsed(start), std::memory_order_relaxed);
+		return fresh;
+	}
+};
@@ -45,7 +45,7 @@ Swapchain Swapchain::createSwapchain(const VulkanContext& vkCtx, vk::SurfaceKHR
 		.setImageFormat(format.format)
 		.setImageColorSpace(format.colorSpace)
 		.setImageExtent(extent)
-		.setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
+		.setImageUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst)
 		.setPresentMode(presentMode)
 		.setMinImageCount(imageCount)
 		.setImageArrayLayers(1)
@@ -138,6 +138,11 @@ vk::SwapchainKHR Swapchain::getSwapchain() const
 	return _swapchain;
 }
 
+const std::vector<vk::Image>& Swapchain::getImages() const
+{
+	return _images;
+}
+
 const std::vector<vk::ImageView>& Swapchain::getImageViews() const
 {
 	return _imageViews;
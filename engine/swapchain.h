@@ -27,6 +27,7 @@ public:
 	vk::Rect2D getScissors() const;
 	vk::SurfaceFormatKHR getFormat() const;
 	vk::SwapchainKHR getSwapchain() const;
+	const std::vector<vk::Image>& getImages() const;
 	const std::vector<vk::ImageView>& getImageViews() const;
 	uint32_t getImageCount() const;
 
@@ -0,0 +1,32 @@
+#include "timestep.h"
+
+FixedTimestep::FixedTimestep(float tickRate, int maxTicks) :
+	_tickDuration(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / tickRate))),
+	_maxTicks(maxTicks),
+	_nextTick(Clock::now())
+{
+}
+
+float FixedTimestep::getTickDuration() const
+{
+	return std::chrono::duration<float>(_tickDuration).count();
+}
+
+FixedTimestep::Clock::time_point FixedTimestep::getNextTick() const
+{
+	return _nextTick;
+}
+
+int FixedTimestep::advance()
+{
+	Clock::time_point now = Clock::now();
+	int ticks = 0;
+	while (now >= _nextTick && ticks < _maxTicks) {
+		_nextTick += _tickDuration;
+		ticks++;
+	}
+	if (now >= _nextTick) {
+		_nextTick = now + _tickDuration;
+	}
+	return ticks;
+}
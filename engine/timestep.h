@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+
+
+class FixedTimestep
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	const Clock::duration _tickDuration;
+	const int _maxTicks;
+	Clock::time_point _nextTick;
+
+public:
+	FixedTimestep(float tickRate, int maxTicks = 5);
+
+	float getTickDuration() const;
+	Clock::time_point getNextTick() const;
+
+	// Number of ticks that are due. When more than maxTicks are behind the rest are dropped
+	// instead of letting the simulation spiral.
+	int advance();
+};
@@ -0,0 +1,116 @@
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <cmath>
+
+size_t getVertexSize(VertexFormat format)
+{
+	return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+const char* getVertexShaderPath(VertexFormat format)
+{
+	return format == VertexFormat::Compact ? "shaders/compact.vert.spv" : "shaders/default.vert.spv";
+}
+
+vk::VertexInputBindingDescription getVertexDescription(VertexFormat format)
+{
+	return vk::VertexInputBindingDescription()
+		.setBinding(0)
+		.setStride((uint32_t)getVertexSize(format))
+		.setInputRate(vk::VertexInputRate::eVertex);
+}
+
+std::array<vk::VertexInputAttributeDescription, 2> getVertexAttributeDescriptions(VertexFormat format)
+{
+	if (format == VertexFormat::Compact) {
+		return {
+			vk::VertexInputAttributeDescription()
+				.setBinding(0)
+				.setLocation(0)
+				.setFormat(vk::Format::eR16G16B16A16Unorm)
+				.setOffset(offsetof(CompactVertex, pos)),
+			vk::VertexInputAttributeDescription()
+				.setBinding(0)
+				.setLocation(1)
+				.setFormat(vk::Format::eR16G16Snorm)
+				.setOffset(offsetof(CompactVertex, normal))
+		};
+	}
+	return {
+		vk::VertexInputAttributeDescription()
+			.setBinding(0)
+			.setLocation(0)
+			.setFormat(vk::Format::eR32G32B32Sfloat)
+			.setOffset(offsetof(Vertex, pos)),
+		vk::VertexInputAttributeDescription()
+			.setBinding(0)
+			.setLocation(1)
+			.setFormat(vk::Format::eR32G32B32Sfloat)
+			.setOffset(offsetof(Vertex, normal))
+	};
+}
+
+static float signNotZero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+glm::vec2 encodeOctahedral(glm::vec3 normal)
+{
+	float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (length == 0.0f) {
+		return glm::vec2(0.0f);
+	}
+	glm::vec2 encoded = glm::vec2(normal.x, normal.y) / length;
+	if (normal.z < 0.0f) {
+		// Fold the lower hemisphere over the diagonals of the square.
+		encoded = glm::vec2(
+			(1.0f - std::abs(encoded.y)) * signNotZero(encoded.x),
+			(1.0f - std::abs(encoded.x)) * signNotZero(encoded.y));
+	}
+	return encoded;
+}
+
+glm::vec3 decodeOctahedral(glm::vec2 encoded)
+{
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+static uint16_t quantizeUnorm(float value)
+{
+	return (uint16_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+}
+
+static int16_t quantizeSnorm(float value)
+{
+	return (int16_t)std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+Dequantization quantizeVertices(std::span<const Vertex> vertices, const Bounds& bounds, std::vector<CompactVertex>& compact)
+{
+	glm::vec3 extent = bounds.max - bounds.min;
+	glm::vec3 invExtent;
+	for (int axis = 0; axis < 3; axis++) {
+		invExtent[axis] = extent[axis] > 0.0f ? 1.0f / extent[axis] : 0.0f;
+	}
+
+	compact.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 position = (vertices[i].pos - bounds.min) * invExtent;
+		glm::vec2 normal = encodeOctahedral(vertices[i].normal);
+		compact[i] = {
+			{ quantizeUnorm(position.x), quantizeUnorm(position.y), quantizeUnorm(position.z), 0 },
+			{ quantizeSnorm(normal.x), quantizeSnorm(normal.y) }
+		};
+	}
+
+	Dequantization dequantization;
+	dequantization.scale = glm::vec4(extent, 0.0f);
+	dequantization.offset = glm::vec4(bounds.min, 1.0f);
+	return dequantization;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "meshfile.h"
+#include "vulkancontext.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+enum class VertexFormat {
+	// Vertex: float position and normal, 24 bytes.
+	Float,
+	// CompactVertex: 16-bit position within the mesh bounds and an octahedral
+	// 2x16-bit normal, 12 bytes.
+	Compact
+};
+
+struct CompactVertex {
+	// Unorm position within the mesh bounds; the fourth component is padding.
+	uint16_t pos[4];
+	// Snorm octahedral normal.
+	int16_t normal[2];
+};
+
+// Maps a compact position back to model space: offset + scale * pos. Laid out to
+// match the push constant block of shaders/compact.vert.
+struct Dequantization {
+	glm::vec4 scale{ 1.0f };
+	glm::vec4 offset{ 0.0f };
+};
+
+size_t getVertexSize(VertexFormat format);
+const char* getVertexShaderPath(VertexFormat format);
+vk::VertexInputBindingDescription getVertexDescription(VertexFormat format);
+std::array<vk::VertexInputAttributeDescription, 2> getVertexAttributeDescriptions(VertexFormat format);
+
+glm::vec2 encodeOctahedral(glm::vec3 normal);
+glm::vec3 decodeOctahedral(glm::vec2 encoded);
+// Quantizes vertices against bounds, which must contain every position.
+Dequantization quantizeVertices(std::span<const Vertex> vertices, const Bounds& bounds, std::vector<CompactVertex>& compact);
@@ -1,6 +1,8 @@
 #define VMA_IMPLEMENTATION
 #include "VulkanContext.h"
 #include <SDL2/SDL_vulkan.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #ifdef NDEBUG
@@ -46,44 +48,110 @@ QueueFamilies findQueueFamilies(vk::PhysicalDevice physicalDevice) {
 			continue;
 		}
 	}
+	if (!families.graphicsInd) {
+		throw std::runtime_error("No graphics queue family");
+	}
+	// Software implementations such as lavapipe expose a single universal family
+	if (!families.computeInd) {
+		families.computeInd = families.graphicsInd;
+	}
+	if (!families.transferInd) {
+		families.transferInd = families.computeInd;
+	}
 	return families;
 }
 
-vk::Device createDevice(vk::PhysicalDevice& physicalDevice,
-	QueueFamilies& queueFamilies,
+struct QueueRequest {
+	uint32_t family;
+	size_t count;
+	std::vector<uint32_t> indices;
+};
+
+std::vector<QueueRequest> requestQueues(vk::PhysicalDevice physicalDevice, const QueueFamilies& queueFamilies,
 	size_t nComputeQueues,
 	size_t nTransferQueues,
 	size_t nGraphicsQueues) {
 
-	std::vector<float> graphicsQueuePriorites = { 1.0, 1.0 };
-	auto graphicsQueueInfo = vk::DeviceQueueCreateInfo()
-		.setQueueCount(graphicsQueuePriorites.size())
-		.setPQueuePriorities(graphicsQueuePriorites.data())
-		.setQueueFamilyIndex(queueFamilies.graphicsInd.value());
+	std::vector<vk::QueueFamilyProperties> properties = physicalDevice.getQueueFamilyProperties();
+	std::vector<QueueRequest> requests = {
+		{ queueFamilies.computeInd.value(), nComputeQueues },
+		{ queueFamilies.transferInd.value(), nTransferQueues },
+		{ queueFamilies.graphicsInd.value(), nGraphicsQueues }
+	};
+
+	std::vector<uint32_t> used(properties.size());
+	for (auto& request : requests) {
+		uint32_t available = properties[request.family].queueCount;
+		for (size_t i = 0; i < request.count; i++) {
+			request.indices.push_back(used[request.family] % available);
+			used[request.family]++;
+		}
+	}
+	return requests;
+}
+
+bool hasDeviceExtension(vk::PhysicalDevice physicalDevice, const char* name) {
+	for (const auto& extension : physicalDevice.enumerateDeviceExtensionProperties()) {
+		if (strcmp(extension.extensionName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	std::vector<float> computeQueuePriorites = { 1.0, 1.0 };
-	auto computeQueueInfo = vk::DeviceQueueCreateInfo()
-		.setQueueCount(computeQueuePriorites.size())
-		.setPQueuePriorities(computeQueuePriorites.data())
-		.setQueueFamilyIndex(queueFamilies.computeInd.value());
+bool hasTimelineSemaphores(vk::PhysicalDevice physicalDevice) {
+	if (!hasDeviceExtension(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+		return false;
+	}
+	auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+	return features.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>().timelineSemaphore;
+}
 
-	std::vector<float> transferQueuePriorites = { 1.0 };
-	auto transferQueueInfo = vk::DeviceQueueCreateInfo()
-		.setQueueCount(transferQueuePriorites.size())
-		.setPQueuePriorities(transferQueuePriorites.data())
-		.setQueueFamilyIndex(queueFamilies.transferInd.value());
+vk::Device createDevice(vk::PhysicalDevice& physicalDevice,
+	const std::vector<QueueRequest>& queueRequests,
+	bool presentable) {
+
+	std::vector<vk::QueueFamilyProperties> properties = physicalDevice.getQueueFamilyProperties();
+	std::vector<uint32_t> queueCounts(properties.size());
+	for (const auto& request : queueRequests) {
+		for (uint32_t index : request.indices) {
+			queueCounts[request.family] = std::max(queueCounts[request.family], index + 1);
+		}
+	}
 
-	std::vector<vk::DeviceQueueCreateInfo> queueInfos = { graphicsQueueInfo, computeQueueInfo, transferQueueInfo };
+	std::vector<float> queuePriorities(*std::max_element(queueCounts.begin(), queueCounts.end()), 1.0f);
+	std::vector<vk::DeviceQueueCreateInfo> queueInfos;
+	for (uint32_t family = 0; family < queueCounts.size(); family++) {
+		if (queueCounts[family] == 0) {
+			continue;
+		}
+		queueInfos.push_back(vk::DeviceQueueCreateInfo()
+			.setQueueCount(queueCounts[family])
+			.setPQueuePriorities(queuePriorities.data())
+			.setQueueFamilyIndex(family));
+	}
 
-	vk::PhysicalDeviceFeatures features;
+	// GPU culling writes a firstInstance into every indirect draw.
+	vk::PhysicalDeviceFeatures features = vk::PhysicalDeviceFeatures()
+		.setDrawIndirectFirstInstance(physicalDevice.getFeatures().drawIndirectFirstInstance);
 
 	const std::vector<const char*> validationLayers = {
 		"VK_LAYER_KHRONOS_validation"
 	};
 
-	const std::vector<const char*> extensions = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
-	};
+	std::vector<const char*> extensions;
+	if (presentable) {
+		extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+	if (hasDeviceExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+		extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+	auto timelineFeatures = vk::PhysicalDeviceTimelineSemaphoreFeatures()
+		.setTimelineSemaphore(true);
+	bool timeline = hasTimelineSemaphores(physicalDevice);
+	if (timeline) {
+		extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	}
 
 	vk::DeviceCreateInfo deviceInfo = vk::DeviceCreateInfo()
 		.setEnabledLayerCount(validationLayers.size())
@@ -93,6 +161,9 @@ vk::Device createDevice(vk::PhysicalDevice& physicalDevice,
 		.setQueueCreateInfoCount(queueInfos.size())
 		.setPQueueCreateInfos(queueInfos.data())
 		.setPEnabledFeatures(&features);
+	if (timeline) {
+		deviceInfo.setPNext(&timelineFeatures);
+	}
 
 	return physicalDevice.createDevice(deviceInfo);
 }
@@ -149,10 +220,20 @@ VulkanContext VulkanContext::createContext(SDL_Window* window)
 	extensionNames.resize(extensionNames.size() + count);
 	SDL_Vulkan_GetInstanceExtensions(window, &count, &*(extensionNames.end() - count));
 
-	return createContext(extensionNames);
+	return createContext(extensionNames, true);
+}
+
+VulkanContext VulkanContext::createHeadlessContext()
+{
+	std::vector<const char*> extensionNames = {};
+	if (debug) {
+		extensionNames.push_back({ VK_EXT_DEBUG_UTILS_EXTENSION_NAME });
+	}
+
+	return createContext(extensionNames, false);
 }
 
-VulkanContext VulkanContext::createContext(const std::vector<const char*>& extensionNames)
+VulkanContext VulkanContext::createContext(const std::vector<const char*>& extensionNames, bool presentable)
 {
 	size_t nComputeQueues = 1, nTransferQueues = 1, nGraphicsQueues = 1;
 	vk::Instance instance = createInstance(extensionNames);
@@ -162,22 +243,23 @@ VulkanContext VulkanContext::createContext(const std::vector<const char*>& exten
 	}
 	vk::PhysicalDevice physicalDevice = getSuitableDevice(instance.enumeratePhysicalDevices());
 	QueueFamilies queueFamilies = findQueueFamilies(physicalDevice);
+	std::vector<QueueRequest> queueRequests = requestQueues(physicalDevice, queueFamilies, nComputeQueues, nTransferQueues, nGraphicsQueues);
 
-	vk::Device device = createDevice(physicalDevice, queueFamilies, nComputeQueues, nTransferQueues, nGraphicsQueues);
+	vk::Device device = createDevice(physicalDevice, queueRequests, presentable);
 
 	std::vector<vk::Queue> computeQueues(nComputeQueues);
 	for (int i = 0; i < computeQueues.size(); i++) {
-		computeQueues[i] = device.getQueue(queueFamilies.computeInd.value(), i);
+		computeQueues[i] = device.getQueue(queueFamilies.computeInd.value(), queueRequests[0].indices[i]);
 	}
 
 	std::vector<vk::Queue> transferQueues(nTransferQueues);
 	for (int i = 0; i < transferQueues.size(); i++) {
-		transferQueues[i] = device.getQueue(queueFamilies.transferInd.value(), i);
+		transferQueues[i] = device.getQueue(queueFamilies.transferInd.value(), queueRequests[1].indices[i]);
 	}
 
 	std::vector<vk::Queue> graphicsQueues(nGraphicsQueues);
 	for (int i = 0; i < graphicsQueues.size(); i++) {
-		graphicsQueues[i] = device.getQueue(queueFamilies.graphicsInd.value(), i);
+		graphicsQueues[i] = device.getQueue(queueFamilies.graphicsInd.value(), queueRequests[2].indices[i]);
 	}
 
 	VmaAllocatorCreateInfo allocatorCreateInfo{};
@@ -190,6 +272,10 @@ VulkanContext VulkanContext::createContext(const std::vector<const char*>& exten
 	return VulkanContext(instance, physicalDevice, device, allocator, queueFamilies, debugUtils, computeQueues, transferQueues, graphicsQueues);
 }
 
+VulkanContext::VulkanContext() : VulkanContext(createHeadlessContext())
+{
+}
+
 VulkanContext::VulkanContext(SDL_Window* window) : VulkanContext(createContext(window))
 {
 }
@@ -266,6 +352,21 @@ QueueFamilies VulkanContext::getQueueFamilies() const
 	return _queueFamilies;
 }
 
+bool VulkanContext::supportsDeviceExtension(const char* name) const
+{
+	return hasDeviceExtension(_physicalDevice, name);
+}
+
+bool VulkanContext::supportsTimelineSemaphores() const
+{
+	return hasTimelineSemaphores(_physicalDevice);
+}
+
+bool VulkanContext::supportsDrawIndirectFirstInstance() const
+{
+	return _physicalDevice.getFeatures().drawIndirectFirstInstance;
+}
+
 vk::Queue VulkanContext::getComputeQueue(int i) const
 {
 	return _computeQueues[i];
@@ -32,8 +32,10 @@ class VulkanContext
 	const std::vector<vk::Queue> _graphicsQueues;
 
 	static VulkanContext createContext(SDL_Window* window);
-	static VulkanContext createContext(const std::vector<const char*>& extensionNames);
+	static VulkanContext createHeadlessContext();
+	static VulkanContext createContext(const std::vector<const char*>& extensionNames, bool presentable);
 public:
+	VulkanContext();
 	VulkanContext(SDL_Window* window);
 	VulkanContext(const vk::Instance instance,
 
@@ -65,6 +67,10 @@ public:
 	vk::Device getDevice() const;
 	VmaAllocator getAllocator() const;
 	QueueFamilies getQueueFamilies() const;
+	// Optional device extensions are enabled whenever the device supports them.
+	bool supportsDeviceExtension(const char* name) const;
+	bool supportsTimelineSemaphores() const;
+	bool supportsDrawIndirectFirstInstance() const;
 
 	vk::Queue getComputeQueue(int i) const;
 
@@ -81,16 +87,22 @@ public:
 template<class T, size_t minPadding = 0>
 struct Buffer {
 	vk::Buffer data;
-	VmaAllocation allocation;
-	size_t size;
+	VmaAllocation allocation = nullptr;
+	size_t size = 0;
 
 	Buffer() = default;
-	Buffer(const VulkanContext& vkCtx, size_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memory = VMA_MEMORY_USAGE_GPU_ONLY) {
+	Buffer(const VulkanContext& vkCtx, size_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memory = VMA_MEMORY_USAGE_GPU_ONLY, const std::vector<uint32_t>& queueFamilies = {}) {
 		this->size = size;
 		auto info = vk::BufferCreateInfo()
 			.setUsage(usage)
 			.setSharingMode(vk::SharingMode::eExclusive)
 			.setSize(getMinSize() * size);
+		if (queueFamilies.size() > 1) {
+			info
+				.setSharingMode(vk::SharingMode::eConcurrent)
+				.setQueueFamilyIndexCount((uint32_t)queueFamilies.size())
+				.setPQueueFamilyIndices(queueFamilies.data());
+		}
 
 		VmaAllocationCreateInfo allocCreateInfo{};
 		allocCreateInfo.usage = memory;